@@ -0,0 +1,301 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Airtime.h"
+
+static void increment(uint16_t &counter, uint8_t count) {
+	counter = (uint16_t)(0xffff - counter) > count ? counter + count : 0xffff;
+}
+
+static void add(uint32_t &counter, uint32_t value) {
+	counter = 0xffffffffUL - counter > value ? counter + value : 0xffffffffUL;
+}
+
+static bool sameAddress(XBeeAddress64 &a, XBeeAddress64 &b) {
+	return a.getMsb() == b.getMsb() && a.getLsb() == b.getLsb();
+}
+
+static bool isBroadcast(XBeeAddress64 &address) {
+	return address.getMsb() == 0 && address.getLsb() == BROADCAST_ADDRESS;
+}
+
+AirtimeStats::AirtimeStats(AirtimeEntry *entries, uint8_t size, uint32_t window) : _pending(_pendingFrames, AIRTIME_PENDING) {
+	_entries = entries;
+	_size = size;
+	_window = window ? window : 1;
+	_byteTime = AIRTIME_BYTE_US;
+	_limit = AIRTIME_FULL;
+	clear();
+}
+
+void AirtimeStats::clear() {
+	_count = 0;
+	_windowStart = millis();
+	_txCurrent = 0;
+	_txPrevious = 0;
+	_channelCurrent = 0;
+	_channelPrevious = 0;
+	_pending.clear();
+}
+
+void AirtimeStats::updateWindow() {
+	uint32_t elapsed = millis() - _windowStart;
+
+	if (elapsed < _window) {
+		return;
+	}
+
+	// when a whole window went by without an update, the previous
+	// window was empty
+	bool skipped = elapsed / _window > 1;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		_entries[i].previous = skipped ? 0 : _entries[i].current;
+		_entries[i].current = 0;
+	}
+
+	_txPrevious = skipped ? 0 : _txCurrent;
+	_txCurrent = 0;
+	_channelPrevious = skipped ? 0 : _channelCurrent;
+	_channelCurrent = 0;
+	_windowStart += elapsed - elapsed % _window;
+}
+
+uint16_t AirtimeStats::getDutyCycle(uint32_t current, uint32_t previous) {
+	// the part of the previous window still inside the sliding window
+	float share = (float)(_window - (millis() - _windowStart)) / _window;
+	// microseconds per millisecond of window, times 10 for 0.01%
+	float duty = (current + previous * share) * 10 / _window;
+
+	return duty < AIRTIME_FULL ? (uint16_t)duty : AIRTIME_FULL;
+}
+
+uint16_t AirtimeStats::getDutyCycle() {
+	updateWindow();
+	return getDutyCycle(_txCurrent, _txPrevious);
+}
+
+uint16_t AirtimeStats::getChannelDutyCycle() {
+	updateWindow();
+	return getDutyCycle(_channelCurrent, _channelPrevious);
+}
+
+uint16_t AirtimeStats::getDutyCycle(AirtimeEntry &entry) {
+	updateWindow();
+	return getDutyCycle(entry.current, entry.previous);
+}
+
+AirtimeEntry* AirtimeStats::get(XBeeAddress64 &address) {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (sameAddress(_entries[i].address, address)) {
+			return &_entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+AirtimeEntry* AirtimeStats::getOrAdd(XBeeAddress64 &address) {
+	AirtimeEntry *entry = get(address);
+
+	if (entry == NULL) {
+		if (_count < _size) {
+			entry = &_entries[_count++];
+		} else if (_size > 0) {
+			// reuse the entry that was updated least recently
+			uint32_t now = millis();
+			entry = &_entries[0];
+
+			for (uint8_t i = 1; i < _count; i++) {
+				if (now - _entries[i].lastUpdate > now - entry->lastUpdate) {
+					entry = &_entries[i];
+				}
+			}
+		} else {
+			return NULL;
+		}
+
+		*entry = AirtimeEntry();
+		entry->address = address;
+	}
+
+	entry->lastUpdate = millis();
+	return entry;
+}
+
+AirtimeEntry* AirtimeStats::getBusiest() {
+	AirtimeEntry *busiest = NULL;
+	uint16_t busiestDuty = 0;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		uint16_t duty = getDutyCycle(_entries[i]);
+
+		if (busiest == NULL || duty > busiestDuty) {
+			busiest = &_entries[i];
+			busiestDuty = duty;
+		}
+	}
+
+	return busiest;
+}
+
+uint32_t AirtimeStats::getTime(uint8_t overhead, uint8_t length, bool acked) {
+	return ((uint32_t)overhead + length + (acked ? AIRTIME_ACK_BYTES : 0)) * _byteTime;
+}
+
+uint32_t AirtimeStats::estimate(XBeeRequest &request, XBeeAddress64 &address, uint8_t &transmissions) {
+	uint8_t length = request.getFrameDataLength();
+	transmissions = 1;
+
+	if (!getDestination(request, address)) {
+		return 0;
+	}
+
+	bool broadcast = isBroadcast(address);
+
+	switch (request.getApiId()) {
+		case ZB_TX_REQUEST:
+			if (broadcast) {
+				transmissions = AIRTIME_ZB_BROADCASTS;
+			}
+
+			return getTime(AIRTIME_ZB_OVERHEAD, length - ZB_TX_API_LENGTH, !broadcast);
+		case ZB_EXPLICIT_TX_REQUEST:
+			if (broadcast) {
+				transmissions = AIRTIME_ZB_BROADCASTS;
+			}
+
+			return getTime(AIRTIME_ZB_OVERHEAD, length - ZB_EXPLICIT_TX_API_LENGTH, !broadcast);
+		case TX_16_REQUEST:
+			// the option follows the address
+			return getTime(AIRTIME_TX16_OVERHEAD, length - TX_16_API_LENGTH, !broadcast && !(request.getFrameData(2) & (DISABLE_ACK_OPTION | BROADCAST_OPTION)));
+		default:
+			return getTime(AIRTIME_TX64_OVERHEAD, length - TX_64_API_LENGTH, !broadcast && !(request.getFrameData(8) & (DISABLE_ACK_OPTION | BROADCAST_OPTION)));
+	}
+}
+
+uint32_t AirtimeStats::estimate(XBeeRequest &request) {
+	XBeeAddress64 address;
+	uint8_t transmissions;
+
+	return estimate(request, address, transmissions) * transmissions;
+}
+
+bool AirtimeStats::canSend(XBeeRequest &request) {
+	if (_limit >= AIRTIME_FULL) {
+		return true;
+	}
+
+	updateWindow();
+	return getDutyCycle(_txCurrent + estimate(request), _txPrevious) <= _limit;
+}
+
+void AirtimeStats::addTx(XBeeAddress64 &address, uint32_t time, uint8_t transmissions) {
+	uint32_t total = time * transmissions;
+
+	updateWindow();
+	add(_txCurrent, total);
+	add(_channelCurrent, total);
+
+	AirtimeEntry *entry = getOrAdd(address);
+
+	if (entry == NULL) {
+		return;
+	}
+
+	increment(entry->txFrames, transmissions);
+	add(entry->txTime, total);
+	add(entry->current, total);
+}
+
+void AirtimeStats::addRx(XBeeAddress64 &address, uint8_t overhead, uint8_t length, bool broadcast) {
+	uint32_t time = getTime(overhead, length, !broadcast);
+
+	updateWindow();
+	add(_channelCurrent, time);
+
+	AirtimeEntry *entry = getOrAdd(address);
+
+	if (entry == NULL) {
+		return;
+	}
+
+	increment(entry->rxFrames, 1);
+	add(entry->rxTime, time);
+	add(entry->current, time);
+}
+
+void AirtimeStats::onSend(XBeeRequest &request) {
+	XBeeAddress64 address;
+	uint8_t transmissions;
+	uint32_t time = estimate(request, address, transmissions);
+
+	if (time == 0) {
+		return;
+	}
+
+	addTx(address, time, transmissions);
+
+	// remember ZB unicasts, to add their retries when the TX status
+	// comes. Series 1 TX statuses have no retry count.
+	uint8_t id = request.getApiId();
+
+	if ((id == ZB_TX_REQUEST || id == ZB_EXPLICIT_TX_REQUEST) && request.getFrameId() != NO_RESPONSE_FRAME_ID && !isBroadcast(address)) {
+		_pending.add(request.getFrameId(), address, time);
+	}
+}
+
+void AirtimeStats::addRetries(uint8_t frameId, uint8_t retries) {
+	XBeePendingFrame *pending = _pending.take(frameId);
+
+	if (pending != NULL && retries) {
+		addTx(pending->address, pending->value, retries);
+	}
+}
+
+void AirtimeStats::onResponse(XBeeResponse &response) {
+	uint8_t id = response.getApiId();
+
+	if (id == ZB_TX_STATUS_RESPONSE) {
+		ZBTxStatusResponse status;
+		response.getZBTxStatusResponse(status);
+		addRetries(status.getFrameId(), status.getTxRetryCount());
+	} else if (id == ZB_RX_RESPONSE || id == ZB_IO_SAMPLE_RESPONSE) {
+		// I/O samples have the same address and option layout, the
+		// samples are the data
+		ZBRxResponse rx;
+		response.getZBRxResponse(rx);
+		addRx(rx.getRemoteAddress64(), AIRTIME_ZB_OVERHEAD, rx.getDataLength(), rx.getOption() & ZB_BROADCAST_PACKET);
+	} else if (id == ZB_EXPLICIT_RX_RESPONSE) {
+		ZBExplicitRxResponse rx;
+		response.getZBExplicitRxResponse(rx);
+		addRx(rx.getRemoteAddress64(), AIRTIME_ZB_OVERHEAD, rx.getDataLength(), rx.getOption() & ZB_BROADCAST_PACKET);
+	} else if (id == RX_16_RESPONSE || id == RX_16_IO_RESPONSE) {
+		// options bit 1 is an address broadcast, bit 2 a PAN broadcast
+		Rx16Response rx;
+		response.getRx16Response(rx);
+		XBeeAddress64 address(0, rx.getRemoteAddress16());
+		addRx(address, AIRTIME_TX16_OVERHEAD, rx.getDataLength(), rx.getOption() & 0x06);
+	} else if (id == RX_64_RESPONSE || id == RX_64_IO_RESPONSE) {
+		Rx64Response rx;
+		response.getRx64Response(rx);
+		addRx(rx.getRemoteAddress64(), AIRTIME_TX64_OVERHEAD, rx.getDataLength(), rx.getOption() & 0x06);
+	}
+}
@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XBee_Airtime_h
+#define XBee_Airtime_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+// Microseconds per byte on air, 250 kbps on 2.4 GHz
+#define AIRTIME_BYTE_US 32
+// Bytes on air besides the payload: PHY header (6), MAC header with
+// 16-bit addresses (11) and, for ZB, the NWK (8) and APS (8) headers
+#define AIRTIME_ZB_OVERHEAD 33
+#define AIRTIME_TX16_OVERHEAD 17
+// MAC header with 64-bit addresses (23)
+#define AIRTIME_TX64_OVERHEAD 29
+// A MAC ACK (11) and the turnaround before it, in byte times
+#define AIRTIME_ACK_BYTES 17
+// Times a ZB broadcast is transmitted by the sender, repeats by
+// neighbours are not counted
+#define AIRTIME_ZB_BROADCASTS 3
+// Number of sent frames waiting for a TX status that are remembered,
+// like LINK_STATS_PENDING
+#ifndef AIRTIME_PENDING
+#define AIRTIME_PENDING 4
+#endif
+// Default window for duty cycles, the observation period of the
+// ETSI 868 MHz duty cycle limits
+#define AIRTIME_WINDOW 3600000UL
+// Duty cycles are in units of 0.01%
+#define AIRTIME_FULL 10000
+
+/**
+ * Estimated airtime used by frames to and from one remote node.
+ * Counters stop at their maximum instead of wrapping.
+ */
+struct AirtimeEntry {
+	// Remote address, 16-bit addresses (Series 1) have a msb of 0
+	XBeeAddress64 address;
+	// millis() of the last update
+	uint32_t lastUpdate;
+	// Transmissions to the node, including retries and broadcast
+	// repeats, and frames received from it
+	uint16_t txFrames;
+	uint16_t rxFrames;
+	// Microseconds on air of the above
+	uint32_t txTime;
+	uint32_t rxTime;
+	// Microseconds on air in both directions in the current and
+	// previous window
+	uint32_t current;
+	uint32_t previous;
+};
+
+/**
+ * Estimates the radio airtime used by the frames that are sent and
+ * received, per remote node and in total, in a table of entries
+ * supplied by the caller, and turns it into duty cycles. When the
+ * table is full, the entry that was updated least recently is reused.
+ *
+ * The airtime of a frame is its payload plus the protocol overhead
+ * (AIRTIME_*_OVERHEAD) times the byte time, plus a MAC ACK for
+ * unicasts. Unicasts are counted once when sent and again for every
+ * retry reported in the ZB TX status (when sent with a frame id, and
+ * only for the last AIRTIME_PENDING ZB unicasts sent, see
+ * getOverwritten()). ZB broadcasts count AIRTIME_ZB_BROADCASTS
+ * transmissions. Received frames, including I/O samples, count as
+ * airtime of the remote node. Only what this radio sends and receives
+ * is seen: hops in between and other traffic on the channel are not.
+ * The byte time defaults to 2.4 GHz, use setByteTime() for other
+ * bands.
+ *
+ * Duty cycles are over a sliding window, estimated from the airtime
+ * in the current window and a share of the previous one, in units of
+ * 0.01% (AIRTIME_FULL is 100%).
+ *
+ * Example, finding the busiest node and staying under a 1% limit:
+ *
+ * AirtimeEntry entries[8];
+ * AirtimeStats airtime(entries, 8);
+ *
+ * void setup() {
+ *   xbee.addObserver(airtime);
+ *   airtime.setLimit(100);
+ * }
+ *
+ * void sendReading() {
+ *   if (airtime.canSend(request))
+ *     xbee.send(request);
+ * }
+ *
+ * void report() {
+ *   AirtimeEntry *busiest = airtime.getBusiest();
+ *   if (busiest)
+ *     Serial.println(airtime.getDutyCycle(*busiest));
+ * }
+ */
+class AirtimeStats : public XBeeObserver {
+public:
+	AirtimeStats(AirtimeEntry *entries, uint8_t size, uint32_t window = AIRTIME_WINDOW);
+
+	void onSend(XBeeRequest &request);
+	void onResponse(XBeeResponse &response);
+
+	/**
+	 * Sets the microseconds per byte on air, e.g. 100 for 80 kbps on
+	 * 868 MHz
+	 */
+	void setByteTime(uint16_t byteTime) { _byteTime = byteTime; }
+	/**
+	 * Sets the duty cycle limit of this radio's transmissions used by
+	 * canSend(), in units of 0.01%, AIRTIME_FULL for none
+	 */
+	void setLimit(uint16_t limit) { _limit = limit; }
+
+	/**
+	 * Returns the estimated microseconds on air of sending the request
+	 * once, 0 if it is not a TX request
+	 */
+	uint32_t estimate(XBeeRequest &request);
+	/**
+	 * Returns true if sending the request keeps the duty cycle of this
+	 * radio at or below the limit
+	 */
+	bool canSend(XBeeRequest &request);
+
+	/**
+	 * Duty cycle of this radio's transmissions
+	 */
+	uint16_t getDutyCycle();
+	/**
+	 * Duty cycle of all frames sent and received
+	 */
+	uint16_t getChannelDutyCycle();
+	/**
+	 * Duty cycle of the frames to and from the node
+	 */
+	uint16_t getDutyCycle(AirtimeEntry &entry);
+
+	/**
+	 * Returns the entry for the given node, or NULL
+	 */
+	AirtimeEntry* get(XBeeAddress64 &address);
+	/**
+	 * Entries in use are numbered from 0 to getCount() - 1
+	 */
+	uint8_t getCount() { return _count; }
+	AirtimeEntry* getEntry(uint8_t index) { return index < _count ? &_entries[index] : NULL; }
+	/**
+	 * Returns the entry with the most airtime in the window, or NULL
+	 */
+	AirtimeEntry* getBusiest();
+	/**
+	 * Number of ZB unicasts forgotten before their TX status arrived,
+	 * their retries are not counted
+	 */
+	uint16_t getOverwritten() { return _pending.getOverwritten(); }
+	void clear();
+private:
+	uint32_t getTime(uint8_t overhead, uint8_t length, bool acked);
+	uint32_t estimate(XBeeRequest &request, XBeeAddress64 &address, uint8_t &transmissions);
+	uint16_t getDutyCycle(uint32_t current, uint32_t previous);
+	void updateWindow();
+	AirtimeEntry* getOrAdd(XBeeAddress64 &address);
+	void addTx(XBeeAddress64 &address, uint32_t time, uint8_t transmissions);
+	void addRx(XBeeAddress64 &address, uint8_t overhead, uint8_t length, bool broadcast);
+	void addRetries(uint8_t frameId, uint8_t retries);
+
+	AirtimeEntry* _entries;
+	uint8_t _size;
+	uint8_t _count;
+	uint32_t _window;
+	uint32_t _windowStart;
+	uint16_t _byteTime;
+	uint16_t _limit;
+	uint32_t _txCurrent;
+	uint32_t _txPrevious;
+	uint32_t _channelCurrent;
+	uint32_t _channelPrevious;
+	// the value of a pending frame is the airtime of one attempt
+	XBeePendingFrame _pendingFrames[AIRTIME_PENDING];
+	XBeePendingFrames _pending;
+};
+
+#endif // XBee_Airtime_h
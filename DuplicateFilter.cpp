@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "DuplicateFilter.h"
+
+static void increment(uint16_t &counter) {
+	if (counter != 0xffff) {
+		counter++;
+	}
+}
+
+DuplicateFilter::DuplicateFilter(DuplicateEntry *entries, uint8_t size, uint16_t expiry) {
+	_entries = entries;
+	_size = size;
+	_expiry = expiry;
+	_keyFunc = NULL;
+	_keyData = 0;
+	clear();
+	resetCounters();
+}
+
+void DuplicateFilter::clear() {
+	_count = 0;
+}
+
+void DuplicateFilter::resetCounters() {
+	_checked = 0;
+	_duplicates = 0;
+}
+
+uint16_t DuplicateFilter::hash(const uint8_t *data, uint8_t length) {
+	// Fletcher-16 with 8-bit wraparound instead of modulo 255
+	uint8_t sum1 = length;
+	uint8_t sum2 = 0;
+
+	for (uint8_t i = 0; i < length; i++) {
+		sum1 += data[i];
+		sum2 += sum1;
+	}
+
+	return ((uint16_t)sum2 << 8) | sum1;
+}
+
+bool DuplicateFilter::reject(XBeeResponse &response) {
+	uint8_t id = response.getApiId();
+
+	if (id == ZB_RX_RESPONSE) {
+		ZBRxResponse rx;
+		response.getZBRxResponse(rx);
+		return isDuplicate(rx.getRemoteAddress64(), rx.getData(), rx.getDataLength());
+	} else if (id == ZB_EXPLICIT_RX_RESPONSE) {
+		ZBExplicitRxResponse rx;
+		response.getZBExplicitRxResponse(rx);
+		return isDuplicate(rx.getRemoteAddress64(), rx.getData(), rx.getDataLength());
+	} else if (id == RX_16_RESPONSE) {
+		Rx16Response rx;
+		response.getRx16Response(rx);
+		XBeeAddress64 address(0, rx.getRemoteAddress16());
+		return isDuplicate(address, rx.getData(), rx.getDataLength());
+	} else if (id == RX_64_RESPONSE) {
+		Rx64Response rx;
+		response.getRx64Response(rx);
+		return isDuplicate(rx.getRemoteAddress64(), rx.getData(), rx.getDataLength());
+	}
+
+	return false;
+}
+
+bool DuplicateFilter::isDuplicate(XBeeAddress64 &source, const uint8_t *data, uint8_t length, uint32_t now) {
+	uint16_t key = _keyFunc ? _keyFunc(data, length, _keyData) : hash(data, length);
+	DuplicateEntry *oldest = NULL;
+
+	increment(_checked);
+
+	for (uint8_t i = 0; i < _count; i++) {
+		DuplicateEntry *entry = &_entries[i];
+		bool expired = now - entry->time >= _expiry;
+
+		if (!expired && entry->key == key && entry->address.getMsb() == source.getMsb() && entry->address.getLsb() == source.getLsb()) {
+			increment(_duplicates);
+			return true;
+		}
+
+		if (oldest == NULL || now - entry->time > now - oldest->time) {
+			oldest = entry;
+		}
+	}
+
+	if (_count < _size) {
+		oldest = &_entries[_count++];
+	} else if (oldest == NULL) {
+		// no table
+		return false;
+	}
+
+	oldest->address = source;
+	oldest->time = now;
+	oldest->key = key;
+
+	return false;
+}
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XBee_DuplicateFilter_h
+#define XBee_DuplicateFilter_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+// Milliseconds a received payload is remembered by default
+#define DUPLICATE_FILTER_EXPIRY 2000
+
+/**
+ * A payload received recently
+ */
+struct DuplicateEntry {
+	// Source address, 16-bit addresses (Series 1) have a msb of 0
+	XBeeAddress64 address;
+	// millis() when first received
+	uint32_t time;
+	// Payload hash or key returned by the key function
+	uint16_t key;
+};
+
+/**
+ * Drops RX frames (ZB RX, ZB explicit RX, RX16 and RX64) that carry
+ * the same payload from the same source as a frame received less than
+ * the expiry time ago, e.g. when a retry is delivered after the
+ * acknowledgement of the first attempt was lost. Register it with
+ * XBeeWithCallbacks::setResponseFilter(), duplicates then never reach
+ * any callback.
+ *
+ * Payloads are compared by a 16-bit Fletcher style checksum of the
+ * payload and its length, which takes two additions per byte. Note that
+ * a node sending the same payload twice on purpose within the expiry
+ * time is also suppressed. If the payload has a sequence number, set a
+ * key function returning it (or a combination of it and the message
+ * type) instead.
+ *
+ * Entries are kept in a table supplied by the caller. When it is full,
+ * the oldest entry is reused, so the table should be large enough for
+ * the frames received within the expiry time.
+ *
+ * Example, with the sequence number in the first payload byte:
+ *
+ * uint16_t sequence(const uint8_t *data, uint8_t length, uintptr_t) {
+ *   return length ? data[0] : 0;
+ * }
+ *
+ * DuplicateEntry entries[8];
+ * DuplicateFilter duplicates(entries, 8);
+ *
+ * void setup() {
+ *   duplicates.setKeyFunction(sequence);
+ *   xbee.setResponseFilter(&duplicates);
+ * }
+ */
+class DuplicateFilter : public XBeeResponseFilter {
+public:
+	DuplicateFilter(DuplicateEntry *entries, uint8_t size, uint16_t expiry = DUPLICATE_FILTER_EXPIRY);
+
+	bool reject(XBeeResponse &response);
+
+	/**
+	 * Returns true if the given payload was received from the given
+	 * source less than the expiry time ago, remembers it otherwise.
+	 */
+	bool isDuplicate(XBeeAddress64 &source, const uint8_t *data, uint8_t length, uint32_t now = millis());
+
+	/**
+	 * Sets the function computing the key of a payload, called with
+	 * the payload, its length and data. Pass NULL to compare payload
+	 * hashes again.
+	 */
+	void setKeyFunction(uint16_t (*func)(const uint8_t*, uint8_t, uintptr_t), uintptr_t data = 0) {
+		_keyFunc = func;
+		_keyData = data;
+	}
+
+	void setExpiry(uint16_t expiry) { _expiry = expiry; }
+	uint16_t getExpiry() { return _expiry; }
+
+	/**
+	 * Number of frames checked and suppressed, these stop at 0xffff
+	 */
+	uint16_t getChecked() { return _checked; }
+	uint16_t getDuplicates() { return _duplicates; }
+	void resetCounters();
+
+	/**
+	 * Forgets all payloads
+	 */
+	void clear();
+
+	/**
+	 * The hash used to compare payloads
+	 */
+	static uint16_t hash(const uint8_t *data, uint8_t length);
+private:
+	DuplicateEntry* _entries;
+	uint8_t _size;
+	uint8_t _count;
+	uint16_t _expiry;
+	uint16_t (*_keyFunc)(const uint8_t*, uint8_t, uintptr_t);
+	uintptr_t _keyData;
+	uint16_t _checked;
+	uint16_t _duplicates;
+};
+
+#endif // XBee_DuplicateFilter_h
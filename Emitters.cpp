@@ -0,0 +1,486 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Emitters.h"
+
+void JsonEncoder::separate() {
+	if (_afterKey) {
+		_afterKey = false;
+		return;
+	}
+
+	if (_first & (1 << _depth))
+		_first &= ~(1 << _depth);
+	else
+		_p->write(',');
+}
+
+void JsonEncoder::begin(char c) {
+	separate();
+	_p->write(c);
+	if (_depth < ENCODER_MAX_DEPTH - 1)
+		_depth++;
+	_first |= (1 << _depth);
+}
+
+void JsonEncoder::end(char c) {
+	_p->write(c);
+	if (_depth > 0)
+		_depth--;
+	// One line per top-level value
+	if (_depth == 0) {
+		_p->write('\n');
+		_first |= 1;
+	}
+}
+
+void JsonEncoder::beginMap() { begin('{'); }
+void JsonEncoder::endMap() { end('}'); }
+void JsonEncoder::beginArray() { begin('['); }
+void JsonEncoder::endArray() { end(']'); }
+
+void JsonEncoder::key(const __FlashStringHelper *name) {
+	separate();
+	_p->write('"');
+	_p->print(name);
+	_p->write('"');
+	_p->write(':');
+	_afterKey = true;
+}
+
+void JsonEncoder::uintValue(uint32_t v) {
+	separate();
+	_p->print(v);
+}
+
+void JsonEncoder::boolValue(bool v) {
+	separate();
+	if (v)
+		_p->print(F("true"));
+	else
+		_p->print(F("false"));
+}
+
+/**
+ * Helper function to write a single string character, escaped as
+ * needed.
+ */
+static void writeJsonChar(Print *p, uint8_t c) {
+	if (c == '"' || c == '\\') {
+		p->write('\\');
+		p->write(c);
+	} else if (c < 0x20 || c >= 0x7f) {
+		uint8_t esc[6] = {'\\', 'u', '0', '0', (uint8_t)hexDigit(c >> 4), (uint8_t)hexDigit(c)};
+		p->write(esc, sizeof(esc));
+	} else {
+		p->write(c);
+	}
+}
+
+void JsonEncoder::stringValue(const __FlashStringHelper *s) {
+	const char *c = (const char*)s;
+	separate();
+	_p->write('"');
+	while (uint8_t b = pgm_read_byte(c++))
+		writeJsonChar(_p, b);
+	_p->write('"');
+}
+
+void JsonEncoder::stringValue(const uint8_t *s, uint8_t len) {
+	separate();
+	_p->write('"');
+	while (len--)
+		writeJsonChar(_p, *s++);
+	_p->write('"');
+}
+
+void JsonEncoder::bytesValue(const uint8_t *buf, uint8_t len) {
+	separate();
+	_p->write('"');
+	while (len--) {
+		uint8_t hex[2] = {(uint8_t)hexDigit(*buf >> 4), (uint8_t)hexDigit(*buf)};
+		_p->write(hex, sizeof(hex));
+		buf++;
+	}
+	_p->write('"');
+}
+
+void JsonEncoder::addressValue(const uint8_t *buf, uint8_t len) {
+	bytesValue(buf, len);
+}
+
+// CBOR major types
+#define CBOR_UINT 0
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_INDEFINITE_ARRAY 0x9f
+#define CBOR_INDEFINITE_MAP 0xbf
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_BREAK 0xff
+
+void CborEncoder::writeHead(uint8_t major, uint32_t v) {
+	major <<= 5;
+	if (v < 24) {
+		_p->write(major | v);
+	} else if (v <= 0xff) {
+		uint8_t head[] = {(uint8_t)(major | 24), (uint8_t)v};
+		_p->write(head, sizeof(head));
+	} else if (v <= 0xffff) {
+		uint8_t head[] = {(uint8_t)(major | 25), (uint8_t)(v >> 8), (uint8_t)v};
+		_p->write(head, sizeof(head));
+	} else {
+		uint8_t head[] = {(uint8_t)(major | 26), (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
+		_p->write(head, sizeof(head));
+	}
+}
+
+void CborEncoder::beginMap() { _p->write(CBOR_INDEFINITE_MAP); }
+void CborEncoder::endMap() { _p->write(CBOR_BREAK); }
+void CborEncoder::beginArray() { _p->write(CBOR_INDEFINITE_ARRAY); }
+void CborEncoder::endArray() { _p->write(CBOR_BREAK); }
+
+void CborEncoder::key(const __FlashStringHelper *name) {
+	stringValue(name);
+}
+
+void CborEncoder::uintValue(uint32_t v) {
+	writeHead(CBOR_UINT, v);
+}
+
+void CborEncoder::boolValue(bool v) {
+	_p->write(v ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void CborEncoder::stringValue(const __FlashStringHelper *s) {
+	const char *c = (const char*)s;
+	writeHead(CBOR_TEXT, strlen_P(c));
+	while (uint8_t b = pgm_read_byte(c++))
+		_p->write(b);
+}
+
+void CborEncoder::stringValue(const uint8_t *s, uint8_t len) {
+	writeHead(CBOR_TEXT, len);
+	_p->write(s, len);
+}
+
+void CborEncoder::bytesValue(const uint8_t *buf, uint8_t len) {
+	writeHead(CBOR_BYTES, len);
+	_p->write(buf, len);
+}
+
+void CborEncoder::addressValue(const uint8_t *buf, uint8_t len) {
+	// The address bytes are already big endian, like CBOR integers
+	if (len == 2) {
+		_p->write((CBOR_UINT << 5) | 25);
+	} else if (len == 8) {
+		_p->write((CBOR_UINT << 5) | 27);
+	} else {
+		bytesValue(buf, len);
+		return;
+	}
+	_p->write(buf, len);
+}
+
+/**
+ * Helper function to start the map for a response.
+ */
+static void beginResponse(ResponseEncoder& e, const __FlashStringHelper *type) {
+	e.beginMap();
+	e.key(F("type"));
+	e.stringValue(type);
+}
+
+/**
+ * Helper function to write a field name followed by a number.
+ */
+static void uintField(ResponseEncoder& e, const __FlashStringHelper *name, uint32_t v) {
+	e.key(name);
+	e.uintValue(v);
+}
+
+/**
+ * Helper function to write a field name followed by an address.
+ */
+static void addressField(ResponseEncoder& e, const __FlashStringHelper *name, const uint8_t *buf, uint8_t len) {
+	e.key(name);
+	e.addressValue(buf, len);
+}
+
+/**
+ * Helper function to write a field name followed by bytes.
+ */
+static void bytesField(ResponseEncoder& e, const __FlashStringHelper *name, const uint8_t *buf, uint8_t len) {
+	e.key(name);
+	e.bytesValue(buf, len);
+}
+
+void encodeResponse(ResponseEncoder& e, ZBTxStatusResponse& status) {
+	beginResponse(e, F("ZBTxStatusResponse"));
+	uintField(e, F("frameId"), status.getFrameId());
+	addressField(e, F("remote16"), status.getFrameData() + 1, 2);
+	uintField(e, F("retries"), status.getTxRetryCount());
+	uintField(e, F("deliveryStatus"), status.getDeliveryStatus());
+	uintField(e, F("discoveryStatus"), status.getDiscoveryStatus());
+	e.endMap();
+}
+
+/**
+ * Helper function to share the fields of the ZB receive responses.
+ */
+static void encodeZBRxFields(ResponseEncoder& e, ZBRxResponse& rx, uint8_t option) {
+	addressField(e, F("remote64"), rx.getFrameData(), 8);
+	addressField(e, F("remote16"), rx.getFrameData() + 8, 2);
+	uintField(e, F("options"), option);
+}
+
+void encodeResponse(ResponseEncoder& e, ZBRxResponse& rx) {
+	beginResponse(e, F("ZBRxResponse"));
+	encodeZBRxFields(e, rx, rx.getOption());
+	bytesField(e, F("data"), rx.getData(), rx.getDataLength());
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, ZBExplicitRxResponse& rx) {
+	beginResponse(e, F("ZBExplicitRxResponse"));
+	encodeZBRxFields(e, rx, rx.getOption());
+	uintField(e, F("srcEndpoint"), rx.getSrcEndpoint());
+	uintField(e, F("dstEndpoint"), rx.getDstEndpoint());
+	uintField(e, F("clusterId"), rx.getClusterId());
+	uintField(e, F("profileId"), rx.getProfileId());
+	bytesField(e, F("data"), rx.getData(), rx.getDataLength());
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, ZBRxIoSampleResponse& rx) {
+	ZBIoSample sample;
+	rx.getSample(sample);
+
+	beginResponse(e, F("ZBRxIoSampleResponse"));
+	encodeZBRxFields(e, rx, rx.getOption());
+	uintField(e, F("digitalMask"), sample.digitalMask);
+	uintField(e, F("analogMask"), sample.analogMask);
+	uintField(e, F("digital"), sample.digital);
+	e.key(F("analog"));
+	e.beginArray();
+	for (uint8_t i = 0; i < sample.analogCount; ++i)
+		e.uintValue(sample.analog[i]);
+	e.endArray();
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, TxStatusResponse& status) {
+	beginResponse(e, F("TxStatusResponse"));
+	uintField(e, F("frameId"), status.getFrameId());
+	uintField(e, F("status"), status.getStatus());
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, Rx16Response& rx) {
+	beginResponse(e, F("Rx16Response"));
+	addressField(e, F("remote16"), rx.getFrameData(), 2);
+	uintField(e, F("rssi"), rx.getRssi());
+	uintField(e, F("options"), rx.getOption());
+	bytesField(e, F("data"), rx.getData(), rx.getDataLength());
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, Rx64Response& rx) {
+	beginResponse(e, F("Rx64Response"));
+	addressField(e, F("remote64"), rx.getFrameData(), 8);
+	uintField(e, F("rssi"), rx.getRssi());
+	uintField(e, F("options"), rx.getOption());
+	bytesField(e, F("data"), rx.getData(), rx.getDataLength());
+	e.endMap();
+}
+
+/**
+ * Helper function to share the sample fields of the two sample
+ * responses.
+ */
+static void encodeSamples(ResponseEncoder& e, RxIoSampleBaseResponse& rx) {
+	RxIoSamples samples;
+	rx.getSamples(samples);
+
+	const uint16_t *digital = samples.getDigitalColumn();
+
+	uintField(e, F("digitalMask"), samples.digitalMask);
+	uintField(e, F("analogMask"), samples.analogMask);
+	e.key(F("samples"));
+	e.beginArray();
+	for (uint8_t s = 0; s < samples.sampleCount; ++s) {
+		e.beginMap();
+		uintField(e, F("digital"), digital ? digital[s] : 0);
+		e.key(F("analog"));
+		e.beginArray();
+		for (uint8_t i = 0; i < RX_IO_MAX_ANALOG; ++i) {
+			if (samples.isAnalogEnabled(i))
+				e.uintValue(samples.getAnalogColumn(i)[s]);
+		}
+		e.endArray();
+		e.endMap();
+	}
+	e.endArray();
+}
+
+void encodeResponse(ResponseEncoder& e, Rx16IoSampleResponse& rx) {
+	beginResponse(e, F("Rx16IoSampleResponse"));
+	addressField(e, F("remote16"), rx.getFrameData(), 2);
+	uintField(e, F("rssi"), rx.getRssi());
+	uintField(e, F("options"), rx.getOption());
+	encodeSamples(e, rx);
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, Rx64IoSampleResponse& rx) {
+	beginResponse(e, F("Rx64IoSampleResponse"));
+	addressField(e, F("remote64"), rx.getFrameData(), 8);
+	uintField(e, F("rssi"), rx.getRssi());
+	uintField(e, F("options"), rx.getOption());
+	encodeSamples(e, rx);
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, ModemStatusResponse& status) {
+	beginResponse(e, F("ModemStatusResponse"));
+	uintField(e, F("status"), status.getStatus());
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, AtCommandResponse& at) {
+	beginResponse(e, F("AtCommandResponse"));
+	uintField(e, F("frameId"), at.getFrameId());
+	e.key(F("command"));
+	e.stringValue(at.getCommand(), 2);
+	uintField(e, F("status"), at.getStatus());
+	bytesField(e, F("value"), at.getValue(), at.getValueLength());
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, RemoteAtCommandResponse& at) {
+	beginResponse(e, F("RemoteAtCommandResponse"));
+	uintField(e, F("frameId"), at.getFrameId());
+	addressField(e, F("remote64"), at.getFrameData() + 1, 8);
+	addressField(e, F("remote16"), at.getFrameData() + 9, 2);
+	e.key(F("command"));
+	e.stringValue(at.getCommand(), 2);
+	uintField(e, F("status"), at.getStatus());
+	bytesField(e, F("value"), at.getValue(), at.getValueLength());
+	e.endMap();
+}
+
+void encodeResponse(ResponseEncoder& e, XBeeResponse& r) {
+	uint8_t id = r.getApiId();
+	// Figure out the API type and call the corresponding function
+	if (id == ZB_TX_STATUS_RESPONSE) {
+		ZBTxStatusResponse response;
+		r.getZBTxStatusResponse(response);
+		encodeResponse(e, response);
+	} else if (id == ZB_RX_RESPONSE) {
+		ZBRxResponse response;
+		r.getZBRxResponse(response);
+		encodeResponse(e, response);
+	} else if (id == ZB_EXPLICIT_RX_RESPONSE) {
+		ZBExplicitRxResponse response;
+		r.getZBExplicitRxResponse(response);
+		encodeResponse(e, response);
+	} else if (id == ZB_IO_SAMPLE_RESPONSE) {
+		ZBRxIoSampleResponse response;
+		r.getZBRxIoSampleResponse(response);
+		encodeResponse(e, response);
+	} else if (id == TX_STATUS_RESPONSE) {
+		TxStatusResponse response;
+		r.getTxStatusResponse(response);
+		encodeResponse(e, response);
+	} else if (id == RX_16_RESPONSE) {
+		Rx16Response response;
+		r.getRx16Response(response);
+		encodeResponse(e, response);
+	} else if (id == RX_64_RESPONSE) {
+		Rx64Response response;
+		r.getRx64Response(response);
+		encodeResponse(e, response);
+	} else if (id == RX_16_IO_RESPONSE) {
+		Rx16IoSampleResponse response;
+		r.getRx16IoSampleResponse(response);
+		encodeResponse(e, response);
+	} else if (id == RX_64_IO_RESPONSE) {
+		Rx64IoSampleResponse response;
+		r.getRx64IoSampleResponse(response);
+		encodeResponse(e, response);
+	} else if (id == MODEM_STATUS_RESPONSE) {
+		ModemStatusResponse response;
+		r.getModemStatusResponse(response);
+		encodeResponse(e, response);
+	} else if (id == AT_COMMAND_RESPONSE) {
+		AtCommandResponse response;
+		r.getAtCommandResponse(response);
+		encodeResponse(e, response);
+	} else if (id == REMOTE_AT_COMMAND_RESPONSE) {
+		RemoteAtCommandResponse response;
+		r.getRemoteAtCommandResponse(response);
+		encodeResponse(e, response);
+	} else {
+		beginResponse(e, F("XBeeResponse"));
+		uintField(e, F("apiId"), id);
+		bytesField(e, F("data"), r.getFrameData(), r.getFrameDataLength());
+		e.endMap();
+	}
+}
+
+/**
+ * Helper function to encode a response into a buffer on the stack,
+ * which is then written to the Print passed as data.
+ */
+template <typename Encoder, typename Response>
+static void emit(Response& r, uintptr_t data) {
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Encoder e(out);
+	encodeResponse(e, r);
+}
+
+void emitJsonCb(ZBTxStatusResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(ZBRxResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(ZBExplicitRxResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(ZBRxIoSampleResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(TxStatusResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(Rx16Response& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(Rx64Response& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(Rx16IoSampleResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(Rx64IoSampleResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(ModemStatusResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(AtCommandResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(RemoteAtCommandResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+void emitJsonCb(XBeeResponse& r, uintptr_t data) { emit<JsonEncoder>(r, data); }
+
+void emitCborCb(ZBTxStatusResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(ZBRxResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(ZBExplicitRxResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(ZBRxIoSampleResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(TxStatusResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(Rx16Response& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(Rx64Response& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(Rx16IoSampleResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(Rx64IoSampleResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(ModemStatusResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(AtCommandResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(RemoteAtCommandResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
+void emitCborCb(XBeeResponse& r, uintptr_t data) { emit<CborEncoder>(r, data); }
@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XBee_Emitters_h
+#define XBee_Emitters_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+#include "Printers.h"
+
+// Maximum nesting of maps and arrays
+#define ENCODER_MAX_DEPTH 8
+
+/**
+ * Interface for writing structured values to a Print. Maps contain
+ * key() calls each followed by one value (or nested map or array),
+ * arrays contain just values.
+ *
+ * The encodeResponse() functions below describe a response through this
+ * interface, so they work with both JsonEncoder and CborEncoder, or any
+ * other implementation.
+ */
+class ResponseEncoder {
+public:
+	ResponseEncoder(Print &p) : _p(&p) {}
+	virtual void beginMap() = 0;
+	virtual void endMap() = 0;
+	virtual void beginArray() = 0;
+	virtual void endArray() = 0;
+	virtual void key(const __FlashStringHelper *name) = 0;
+	virtual void uintValue(uint32_t v) = 0;
+	virtual void boolValue(bool v) = 0;
+	/**
+	 * A string from flash
+	 */
+	virtual void stringValue(const __FlashStringHelper *s) = 0;
+	/**
+	 * A string of len characters, not necessarily terminated
+	 */
+	virtual void stringValue(const uint8_t *s, uint8_t len) = 0;
+	/**
+	 * Arbitrary bytes, such as a payload
+	 */
+	virtual void bytesValue(const uint8_t *buf, uint8_t len) = 0;
+	/**
+	 * A big endian 16-bit or 64-bit address, straight from frame data
+	 */
+	virtual void addressValue(const uint8_t *buf, uint8_t len) = 0;
+protected:
+	Print* _p;
+};
+
+/**
+ * Writes each response as a single line of JSON, so the output is in
+ * JSON Lines format. Bytes and addresses are written as strings of
+ * uppercase hex digits, like the printers do.
+ */
+class JsonEncoder : public ResponseEncoder {
+public:
+	JsonEncoder(Print &p) : ResponseEncoder(p), _depth(0), _first(1), _afterKey(false) {}
+	void beginMap();
+	void endMap();
+	void beginArray();
+	void endArray();
+	void key(const __FlashStringHelper *name);
+	void uintValue(uint32_t v);
+	void boolValue(bool v);
+	void stringValue(const __FlashStringHelper *s);
+	void stringValue(const uint8_t *s, uint8_t len);
+	void bytesValue(const uint8_t *buf, uint8_t len);
+	void addressValue(const uint8_t *buf, uint8_t len);
+private:
+	void separate();
+	void begin(char c);
+	void end(char c);
+
+	uint8_t _depth;
+	// bit n is set while no value was written at depth n yet
+	uint8_t _first;
+	bool _afterKey;
+};
+
+/**
+ * Writes each response as a CBOR (RFC 7049) map. Maps and arrays use
+ * indefinite lengths, so nothing needs to be buffered. Bytes are
+ * written as byte strings and addresses as unsigned integers.
+ */
+class CborEncoder : public ResponseEncoder {
+public:
+	CborEncoder(Print &p) : ResponseEncoder(p) {}
+	void beginMap();
+	void endMap();
+	void beginArray();
+	void endArray();
+	void key(const __FlashStringHelper *name);
+	void uintValue(uint32_t v);
+	void boolValue(bool v);
+	void stringValue(const __FlashStringHelper *s);
+	void stringValue(const uint8_t *s, uint8_t len);
+	void bytesValue(const uint8_t *buf, uint8_t len);
+	void addressValue(const uint8_t *buf, uint8_t len);
+private:
+	void writeHead(uint8_t major, uint32_t v);
+};
+
+// Describe a response to an encoder. Every response is a map with a
+// "type" field containing the class name, followed by the fields of
+// the response.
+void encodeResponse(ResponseEncoder& e, ZBTxStatusResponse& status);
+void encodeResponse(ResponseEncoder& e, ZBRxResponse& rx);
+void encodeResponse(ResponseEncoder& e, ZBExplicitRxResponse& rx);
+void encodeResponse(ResponseEncoder& e, ZBRxIoSampleResponse& rx);
+void encodeResponse(ResponseEncoder& e, TxStatusResponse& status);
+void encodeResponse(ResponseEncoder& e, Rx16Response& rx);
+void encodeResponse(ResponseEncoder& e, Rx64Response& rx);
+void encodeResponse(ResponseEncoder& e, Rx16IoSampleResponse& rx);
+void encodeResponse(ResponseEncoder& e, Rx64IoSampleResponse& rx);
+void encodeResponse(ResponseEncoder& e, ModemStatusResponse& status);
+void encodeResponse(ResponseEncoder& e, AtCommandResponse& at);
+void encodeResponse(ResponseEncoder& e, RemoteAtCommandResponse& at);
+// Responses of other types are written with their API ID and raw
+// frame data
+void encodeResponse(ResponseEncoder& e, XBeeResponse& r);
+
+// The following functions are intended to be used as callbacks, like
+// printResponseCb(), and require a Print* to be passed as the data
+// parameter. For example, to send all responses to a gateway as JSON
+// Lines over Serial:
+//
+// xbee.onResponse(emitJsonCb, (uintptr_t)(Print*)&Serial);
+
+// emitJsonCb writes a response as one line of JSON.
+void emitJsonCb(ZBTxStatusResponse& status, uintptr_t data);
+void emitJsonCb(ZBRxResponse& rx, uintptr_t data);
+void emitJsonCb(ZBExplicitRxResponse& rx, uintptr_t data);
+void emitJsonCb(ZBRxIoSampleResponse& rx, uintptr_t data);
+void emitJsonCb(TxStatusResponse& status, uintptr_t data);
+void emitJsonCb(Rx16Response& rx, uintptr_t data);
+void emitJsonCb(Rx64Response& rx, uintptr_t data);
+void emitJsonCb(Rx16IoSampleResponse& rx, uintptr_t data);
+void emitJsonCb(Rx64IoSampleResponse& rx, uintptr_t data);
+void emitJsonCb(ModemStatusResponse& status, uintptr_t data);
+void emitJsonCb(AtCommandResponse& at, uintptr_t data);
+void emitJsonCb(RemoteAtCommandResponse& at, uintptr_t data);
+void emitJsonCb(XBeeResponse& r, uintptr_t data);
+
+// emitCborCb writes a response as one CBOR map.
+void emitCborCb(ZBTxStatusResponse& status, uintptr_t data);
+void emitCborCb(ZBRxResponse& rx, uintptr_t data);
+void emitCborCb(ZBExplicitRxResponse& rx, uintptr_t data);
+void emitCborCb(ZBRxIoSampleResponse& rx, uintptr_t data);
+void emitCborCb(TxStatusResponse& status, uintptr_t data);
+void emitCborCb(Rx16Response& rx, uintptr_t data);
+void emitCborCb(Rx64Response& rx, uintptr_t data);
+void emitCborCb(Rx16IoSampleResponse& rx, uintptr_t data);
+void emitCborCb(Rx64IoSampleResponse& rx, uintptr_t data);
+void emitCborCb(ModemStatusResponse& status, uintptr_t data);
+void emitCborCb(AtCommandResponse& at, uintptr_t data);
+void emitCborCb(RemoteAtCommandResponse& at, uintptr_t data);
+void emitCborCb(XBeeResponse& r, uintptr_t data);
+
+// The following functions are non-callback version of the above,
+// intended to be called with Print instance (such as Serial) directly,
+// saving the casts.
+
+// Write a response as one line of JSON
+inline void emitJson(ZBTxStatusResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(ZBRxResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(ZBExplicitRxResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(ZBRxIoSampleResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(TxStatusResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(Rx16Response& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(Rx64Response& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(Rx16IoSampleResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(Rx64IoSampleResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(ModemStatusResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(AtCommandResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(RemoteAtCommandResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+inline void emitJson(XBeeResponse& r, Print& print) { emitJsonCb(r, (uintptr_t)(Print*)&print); }
+
+// Write a response as one CBOR map
+inline void emitCbor(ZBTxStatusResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(ZBRxResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(ZBExplicitRxResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(ZBRxIoSampleResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(TxStatusResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(Rx16Response& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(Rx64Response& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(Rx16IoSampleResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(Rx64IoSampleResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(ModemStatusResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(AtCommandResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(RemoteAtCommandResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+inline void emitCbor(XBeeResponse& r, Print& print) { emitCborCb(r, (uintptr_t)(Print*)&print); }
+
+#endif // XBee_Emitters_h
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ARDUINO
+
+#include "FdStream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+FdStream::FdStream(int fd) {
+	_fd = fd;
+	_pos = 0;
+	_length = 0;
+	_closed = false;
+
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags != -1) {
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	}
+}
+
+bool FdStream::fill() {
+	if (_pos < _length) {
+		return true;
+	}
+
+	if (_closed) {
+		return false;
+	}
+
+	ssize_t n;
+
+	do {
+		n = ::read(_fd, _buffer, sizeof(_buffer));
+	} while (n < 0 && errno == EINTR);
+
+	if (n > 0) {
+		_pos = 0;
+		_length = n;
+		return true;
+	}
+
+	if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+		_closed = true;
+	}
+
+	return false;
+}
+
+int FdStream::available() {
+	return fill() ? _length - _pos : 0;
+}
+
+int FdStream::read() {
+	return fill() ? _buffer[_pos++] : -1;
+}
+
+int FdStream::peek() {
+	return fill() ? _buffer[_pos] : -1;
+}
+
+size_t FdStream::write(uint8_t b) {
+	return write(&b, 1);
+}
+
+size_t FdStream::write(const uint8_t *buffer, size_t size) {
+	size_t written = 0;
+
+	while (written < size) {
+		ssize_t n = ::write(_fd, buffer + written, size - written);
+
+		if (n > 0) {
+			written += n;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			struct pollfd pfd = { _fd, POLLOUT, 0 };
+			poll(&pfd, 1, -1);
+		} else {
+			break;
+		}
+	}
+
+	return written;
+}
+
+bool FdStream::waitAvailable(int timeout) {
+	if (available()) {
+		return true;
+	}
+
+	if (_closed) {
+		return false;
+	}
+
+	struct pollfd pfd = { _fd, POLLIN, 0 };
+
+	while (poll(&pfd, 1, timeout) < 0 && errno == EINTR)
+		;
+
+	return available() > 0;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XBee_FdStream_h
+#define XBee_FdStream_h
+
+// Only for builds on a host (e.g. a Linux gateway), using a POSIX file
+// descriptor for a serial port, pipe or socket
+#ifndef ARDUINO
+
+#include "WProgram.h"
+
+// Bytes read from the file descriptor at once
+#define FD_STREAM_BUFFER_SIZE 64
+
+/**
+ * A Stream on a POSIX file descriptor, for using XBee in an event loop
+ * (poll, epoll, libuv...) instead of spinning on available(). The file
+ * descriptor is switched to non-blocking mode; watch getFd() for
+ * readability and call XBeeWithCallbacks::step() when it is readable.
+ * Writes wait until the file descriptor accepts all bytes.
+ *
+ * Bytes are read from the file descriptor FD_STREAM_BUFFER_SIZE at a
+ * time, and step() stops after a limited number of bytes and frames,
+ * so input can be left in the buffer (see buffered()) or in the kernel
+ * after step() returns. Only wait for readability when available()
+ * returns 0: it reads until the file descriptor would block, which
+ * also suits edge-triggered epoll.
+ *
+ * Example:
+ *
+ * int fd = open("/dev/ttyUSB0", O_RDWR | O_NOCTTY);
+ * FdStream serial(fd);
+ * xbee.setSerial(serial);
+ *
+ * struct pollfd pfd = { serial.getFd(), POLLIN, 0 };
+ * while (!serial.isClosed()) {
+ *   if (!serial.available() && poll(&pfd, 1, -1) < 0)
+ *     break;
+ *   xbee.step();
+ * }
+ */
+class FdStream : public Stream {
+public:
+	FdStream(int fd);
+
+	int getFd() { return _fd; }
+
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t b);
+	size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+
+	/**
+	 * Returns the number of bytes read from the file descriptor but not
+	 * from this stream yet. poll() does not see these, so call step()
+	 * again instead of waiting while this is not 0.
+	 */
+	int buffered() { return _length - _pos; }
+
+	/**
+	 * Waits up to timeout milliseconds (-1 for ever) for data to read,
+	 * without using the CPU. Returns true if data is available.
+	 */
+	bool waitAvailable(int timeout);
+
+	/**
+	 * Returns true when the other end was closed or reading failed
+	 * (other than for lack of data)
+	 */
+	bool isClosed() { return _closed; }
+private:
+	bool fill();
+
+	int _fd;
+	uint8_t _buffer[FD_STREAM_BUFFER_SIZE];
+	uint8_t _pos;
+	uint8_t _length;
+	bool _closed;
+};
+
+#endif // ARDUINO
+
+#endif // XBee_FdStream_h
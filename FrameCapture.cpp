@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FrameCapture.h"
+
+static const uint8_t captureHeader[] = { 'X', 'B', 'C', '1' };
+
+CaptureStream::CaptureStream(Stream &radio, Print &capture) {
+	_radio = &radio;
+	_capture = &capture;
+	_rx.length = 0;
+	_rx.continued = false;
+	_tx.length = 0;
+	_tx.continued = false;
+	_lastTime = 0;
+	_started = false;
+}
+
+int CaptureStream::available() {
+	return _radio->available();
+}
+
+int CaptureStream::read() {
+	int b = _radio->read();
+
+	if (b >= 0) {
+		add(_rx, CAPTURE_FROM_RADIO, b);
+	}
+
+	return b;
+}
+
+int CaptureStream::peek() {
+	return _radio->peek();
+}
+
+size_t CaptureStream::write(uint8_t b) {
+	add(_tx, CAPTURE_TO_RADIO, b);
+	return _radio->write(b);
+}
+
+void CaptureStream::flush() {
+	writeRecord(_rx, CAPTURE_FROM_RADIO);
+	writeRecord(_tx, CAPTURE_TO_RADIO);
+	_radio->flush();
+}
+
+void CaptureStream::add(Direction &dir, uint8_t flags, uint8_t b) {
+	if (b == START_BYTE) {
+		// A new frame, write the previous one
+		writeRecord(dir, flags);
+		dir.continued = false;
+	} else if (dir.length == CAPTURE_BUFFER_SIZE) {
+		writeRecord(dir, flags);
+		dir.continued = true;
+	}
+
+	if (dir.length == 0) {
+		dir.time = micros();
+	}
+
+	dir.buffer[dir.length++] = b;
+}
+
+void CaptureStream::writeRecord(Direction &dir, uint8_t flags) {
+	if (dir.length == 0) {
+		return;
+	}
+
+	if (!_started) {
+		_capture->write(captureHeader, sizeof(captureHeader));
+		_lastTime = dir.time;
+		_started = true;
+	}
+
+	if (dir.continued) {
+		flags |= CAPTURE_CONTINUED;
+	}
+
+	// Records are written in the order they complete, which is not
+	// necessarily the order they started in, so never go back in time
+	unsigned long delta = dir.time - _lastTime;
+	if ((long)delta < 0) {
+		delta = 0;
+	} else {
+		_lastTime = dir.time;
+	}
+
+	_capture->write(flags);
+	writeVarint(delta);
+	writeVarint(dir.length);
+	_capture->write(dir.buffer, dir.length);
+
+	dir.length = 0;
+}
+
+void CaptureStream::writeVarint(uint32_t v) {
+	while (v >= 0x80) {
+		_capture->write((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+
+	_capture->write((uint8_t)v);
+}
+
+ReplayStream::ReplayStream(Stream &capture, bool realtime) {
+	_capture = &capture;
+	_realtime = realtime;
+	_started = false;
+	_error = false;
+	_pending = false;
+	_flags = 0;
+	_remaining = 0;
+	_due = 0;
+	_start = 0;
+	_written = 0;
+	_skipped = 0;
+}
+
+bool ReplayStream::readVarint(uint32_t &v) {
+	v = 0;
+
+	for (uint8_t shift = 0; shift < 32; shift += 7) {
+		int b = _capture->read();
+
+		if (b < 0) {
+			return false;
+		}
+
+		v |= (uint32_t)(b & 0x7f) << shift;
+
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ReplayStream::nextRecord() {
+	if (_error) {
+		return false;
+	}
+
+	if (!_started) {
+		if (_capture->available() < (int)sizeof(captureHeader)) {
+			return false;
+		}
+
+		for (uint8_t i = 0; i < sizeof(captureHeader); i++) {
+			if (_capture->read() != captureHeader[i]) {
+				_error = true;
+				return false;
+			}
+		}
+
+		_start = micros();
+		_started = true;
+	}
+
+	while (_remaining == 0 || !_pending) {
+		if (_remaining > 0) {
+			// Rest of a record that was sent to the radio
+			while (_remaining > 0 && _capture->read() >= 0) {
+				_remaining--;
+				_skipped++;
+			}
+
+			if (_remaining > 0) {
+				return false;
+			}
+		}
+
+		int flags = _capture->read();
+		uint32_t delta, length;
+
+		if (flags < 0) {
+			return false;
+		}
+
+		if (!readVarint(delta) || !readVarint(length)) {
+			_error = true;
+			return false;
+		}
+
+		_flags = flags;
+		_remaining = length;
+		_due += delta;
+		_pending = !(_flags & CAPTURE_TO_RADIO);
+	}
+
+	return true;
+}
+
+int ReplayStream::available() {
+	if (_remaining == 0 || !_pending) {
+		if (!nextRecord()) {
+			return 0;
+		}
+	}
+
+	if (_realtime && (long)(micros() - _start - _due) < 0) {
+		return 0;
+	}
+
+	int avail = _capture->available();
+
+	if ((uint32_t)avail > _remaining) {
+		avail = _remaining;
+	}
+
+	return avail;
+}
+
+int ReplayStream::read() {
+	if (available() <= 0) {
+		return -1;
+	}
+
+	_remaining--;
+	return _capture->read();
+}
+
+int ReplayStream::peek() {
+	if (available() <= 0) {
+		return -1;
+	}
+
+	return _capture->peek();
+}
+
+size_t ReplayStream::write(uint8_t) {
+	_written++;
+	return 1;
+}
+
+bool ReplayStream::isFinished() {
+	return _error || (_started && available() == 0 && !_remaining && _capture->available() == 0);
+}
@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XBee_FrameCapture_h
+#define XBee_FrameCapture_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+// Bytes buffered per direction before a record is written. Frames
+// longer than this are written as multiple records.
+#define CAPTURE_BUFFER_SIZE 64
+
+// Record flags
+#define CAPTURE_FROM_RADIO 0x00
+#define CAPTURE_TO_RADIO 0x01
+#define CAPTURE_CONTINUED 0x02
+
+/**
+ * A Stream that sits between XBee and the serial port and records all
+ * bytes passing through, in both directions, to a Print (an SD card
+ * File, a flash writer, or a file on a host).
+ *
+ * The capture starts with the four bytes "XBC1". Every record after
+ * that is:
+ *  - a flags byte: CAPTURE_TO_RADIO for bytes sent to the radio,
+ *    CAPTURE_CONTINUED when the bytes continue the previous record in
+ *    the same direction,
+ *  - a varint with the micros() elapsed since the previous record,
+ *  - a varint with the number of bytes,
+ *  - the raw (still escaped) bytes.
+ * Varints are 7 bits per byte, least significant first, with the high
+ * bit set on all but the last byte.
+ *
+ * A record normally holds one API frame: a record is written when a
+ * new start byte is seen, or when CAPTURE_BUFFER_SIZE bytes are
+ * buffered. Call flush() to write the last, incomplete records (e.g.
+ * before closing the file).
+ *
+ * Example:
+ *
+ * File log = SD.open("xbee.cap", FILE_WRITE);
+ * CaptureStream capture(Serial1, log);
+ * xbee.setSerial(capture);
+ */
+class CaptureStream : public Stream {
+public:
+	CaptureStream(Stream &radio, Print &capture);
+
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t b);
+	/**
+	 * Writes buffered records to the capture and flushes the radio
+	 */
+	void flush();
+	using Print::write;
+private:
+	struct Direction {
+		uint8_t buffer[CAPTURE_BUFFER_SIZE];
+		uint8_t length;
+		bool continued;
+		unsigned long time;
+	};
+
+	void add(Direction &dir, uint8_t flags, uint8_t b);
+	void writeRecord(Direction &dir, uint8_t flags);
+	void writeVarint(uint32_t v);
+
+	Stream* _radio;
+	Print* _capture;
+	Direction _rx;
+	Direction _tx;
+	unsigned long _lastTime;
+	bool _started;
+};
+
+/**
+ * A Stream that plays back a capture made by CaptureStream, to pass to
+ * XBee::setSerial(). Bytes that were received from the radio are
+ * returned by read(), bytes that were sent to the radio are skipped and
+ * anything written is discarded (but counted).
+ *
+ * In realtime mode, records only become available at the same time
+ * (relative to the first read) as they were captured. Otherwise,
+ * everything is available as fast as it can be read, which makes the
+ * replay deterministic and useful to benchmark parsing and dispatching.
+ */
+class ReplayStream : public Stream {
+public:
+	ReplayStream(Stream &capture, bool realtime = false);
+
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t b);
+	using Print::write;
+
+	/**
+	 * Returns true when the whole capture has been played back
+	 */
+	bool isFinished();
+	/**
+	 * Returns true if the capture does not start with the right header
+	 */
+	bool isError() { return _error; }
+	/**
+	 * Number of bytes written to this stream during the replay
+	 */
+	uint32_t getBytesWritten() { return _written; }
+	/**
+	 * Number of bytes in the capture that were sent to the radio
+	 */
+	uint32_t getBytesSkipped() { return _skipped; }
+private:
+	bool nextRecord();
+	bool readVarint(uint32_t &v);
+
+	Stream* _capture;
+	bool _realtime;
+	bool _started;
+	bool _error;
+	bool _pending;
+	uint8_t _flags;
+	uint32_t _remaining;
+	unsigned long _due;
+	unsigned long _start;
+	uint32_t _written;
+	uint32_t _skipped;
+};
+
+#endif // XBee_FrameCapture_h
@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LatencyStats.h"
+
+static uint8_t bucketIndex(uint32_t latency) {
+	uint8_t i = 0;
+
+	while (latency && i < LATENCY_BUCKETS - 1) {
+		latency >>= 1;
+		i++;
+	}
+
+	return i;
+}
+
+uint32_t LatencyHistogram::getCount() const {
+	uint32_t count = 0;
+
+	for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+		count += buckets[i];
+	}
+
+	return count;
+}
+
+uint32_t LatencyHistogram::getPercentile(uint8_t percent) const {
+	uint32_t count = getCount();
+
+	if (count == 0) {
+		return 0;
+	}
+
+	// rank of the sample at the percentile, rounded up
+	uint32_t rank = ((uint64_t)count * percent + 99) / 100;
+	uint32_t seen = 0;
+
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+		seen += buckets[i];
+
+		if (seen >= rank) {
+			return i ? ((uint32_t)1 << i) - 1 : 0;
+		}
+	}
+
+	return (uint32_t)1 << (LATENCY_BUCKETS - 2);
+}
+
+void LatencyHistogram::clear() {
+	for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+		buckets[i] = 0;
+	}
+}
+
+LatencyStats::LatencyStats(uint8_t mode) : _pending(_pendingFrames, LATENCY_PENDING) {
+	_mode = mode;
+	clear();
+}
+
+void LatencyStats::clear() {
+	_count = 0;
+	_other.clear();
+	_pending.clear();
+}
+
+LatencyHistogram* LatencyStats::find(XBeeAddress64 &key) {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (_histograms[i].key.getMsb() == key.getMsb() && _histograms[i].key.getLsb() == key.getLsb()) {
+			return &_histograms[i];
+		}
+	}
+
+	return NULL;
+}
+
+LatencyHistogram* LatencyStats::get(XBeeAddress64 &destination) {
+	return _mode == LATENCY_PER_DESTINATION ? find(destination) : NULL;
+}
+
+LatencyHistogram* LatencyStats::get(uint8_t apiId) {
+	XBeeAddress64 key(0, apiId);
+	return _mode == LATENCY_PER_API_ID ? find(key) : NULL;
+}
+
+void LatencyStats::add(XBeeAddress64 &key, uint32_t latency) {
+	LatencyHistogram *h = find(key);
+
+	if (h == NULL) {
+		if (_count < LATENCY_HISTOGRAMS) {
+			h = &_histograms[_count++];
+			h->key = key;
+			h->clear();
+		} else {
+			h = &_other;
+		}
+	}
+
+	latency_count_t &bucket = h->buckets[bucketIndex(latency)];
+
+	if (bucket != (latency_count_t)~0) {
+		bucket++;
+	}
+}
+
+void LatencyStats::onSend(XBeeRequest &request) {
+	if (request.getFrameId() == NO_RESPONSE_FRAME_ID) {
+		return;
+	}
+
+	XBeeAddress64 key(0, request.getApiId());
+
+	if (_mode == LATENCY_PER_DESTINATION && !getDestination(request, key)) {
+		return;
+	}
+
+	_pending.add(request.getFrameId(), key, millis());
+}
+
+void LatencyStats::onResponse(XBeeResponse &response) {
+	uint8_t id = response.getApiId();
+
+	// All of these have the frame id as the first byte
+	if (id != TX_STATUS_RESPONSE && id != ZB_TX_STATUS_RESPONSE &&
+	    id != AT_COMMAND_RESPONSE && id != REMOTE_AT_COMMAND_RESPONSE) {
+		return;
+	}
+
+	if (response.getFrameDataLength() < 1) {
+		return;
+	}
+
+	XBeePendingFrame *p = _pending.take(response.getFrameData()[0]);
+
+	if (p != NULL) {
+		add(p->address, millis() - p->value);
+	}
+}
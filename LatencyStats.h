@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XBee_LatencyStats_h
+#define XBee_LatencyStats_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+#ifdef __AVR__
+// Histograms kept, samples for further keys go into getOther()
+#define LATENCY_HISTOGRAMS 6
+// Bucket i counts latencies of 2^(i-1) up to 2^i - 1 ms (bucket 0
+// counts 0 ms), the last bucket counts everything longer
+#define LATENCY_BUCKETS 13
+typedef uint16_t latency_count_t;
+#else
+#define LATENCY_HISTOGRAMS 32
+#define LATENCY_BUCKETS 18
+typedef uint32_t latency_count_t;
+#endif
+
+// Sent frames waiting for a status that are remembered, raise it (e.g.
+// with -DLATENCY_PENDING=32) when more frames are in flight at once
+#ifndef LATENCY_PENDING
+#ifdef __AVR__
+#define LATENCY_PENDING 4
+#else
+#define LATENCY_PENDING 16
+#endif
+#endif
+
+// What LatencyStats keeps histograms for
+#define LATENCY_PER_DESTINATION 0
+#define LATENCY_PER_API_ID 1
+
+/**
+ * Histogram of the time between sending a frame and receiving its
+ * status, in log2-sized buckets of milliseconds. Counts stop at their
+ * maximum value instead of wrapping.
+ */
+struct LatencyHistogram {
+	// Destination address, or API ID of the request in the lsb
+	XBeeAddress64 key;
+	latency_count_t buckets[LATENCY_BUCKETS];
+
+	uint32_t getCount() const;
+	/**
+	 * Returns the latency in ms below which the given percentage of
+	 * the frames got their status. This is the upper bound of the
+	 * bucket the percentile falls into (or the lower bound for the
+	 * last bucket), so it overestimates by at most a factor 2.
+	 * Returns 0 when the histogram is empty.
+	 */
+	uint32_t getPercentile(uint8_t percent) const;
+	void clear();
+};
+
+/**
+ * Measures how long it takes for a sent frame to get its status: a TX
+ * status for TX requests, or the AT command response for (remote) AT
+ * commands. Measurements go into a histogram per destination address
+ * (TX requests only) or per API ID of the request.
+ *
+ * Only frames sent with a frame id through the XBee object the
+ * collector is registered with are measured. At most LATENCY_PENDING
+ * frames can be waiting for a status at the same time, older ones are
+ * forgotten and counted by getOverwritten().
+ *
+ * Example:
+ *
+ * LatencyStats latency;
+ *
+ * void setup() {
+ *   xbee.addObserver(latency);
+ * }
+ *
+ * void report() {
+ *   LatencyHistogram *h = latency.get(coordinator);
+ *   if (h) {
+ *     Serial.print(h->getPercentile(50));
+ *     Serial.print(F(" ms median, "));
+ *     Serial.print(h->getPercentile(99));
+ *     Serial.println(F(" ms 99th percentile"));
+ *   }
+ * }
+ */
+class LatencyStats : public XBeeObserver {
+public:
+	LatencyStats(uint8_t mode = LATENCY_PER_DESTINATION);
+
+	void onSend(XBeeRequest &request);
+	void onResponse(XBeeResponse &response);
+
+	/**
+	 * Returns the histogram for the given destination, or NULL
+	 */
+	LatencyHistogram* get(XBeeAddress64 &destination);
+	/**
+	 * Returns the histogram for the given request API ID, or NULL
+	 */
+	LatencyHistogram* get(uint8_t apiId);
+	/**
+	 * Histograms in use are numbered from 0 to getCount() - 1
+	 */
+	uint8_t getCount() { return _count; }
+	LatencyHistogram* getHistogram(uint8_t index) { return index < _count ? &_histograms[index] : NULL; }
+	/**
+	 * Samples for keys that did not fit in the table
+	 */
+	LatencyHistogram& getOther() { return _other; }
+	/**
+	 * Number of sent frames forgotten before their status arrived
+	 */
+	uint16_t getOverwritten() { return _pending.getOverwritten(); }
+	void clear();
+private:
+
+	LatencyHistogram* find(XBeeAddress64 &key);
+	void add(XBeeAddress64 &key, uint32_t latency);
+
+	uint8_t _mode;
+	uint8_t _count;
+	LatencyHistogram _histograms[LATENCY_HISTOGRAMS];
+	LatencyHistogram _other;
+	XBeePendingFrame _pendingFrames[LATENCY_PENDING];
+	XBeePendingFrames _pending;
+};
+
+#endif // XBee_LatencyStats_h
@@ -0,0 +1,264 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LinkStats.h"
+
+static void increment(uint16_t &counter) {
+	if (counter != 0xffff) {
+		counter++;
+	}
+}
+
+static bool sameAddress(XBeeAddress64 &a, XBeeAddress64 &b) {
+	return a.getMsb() == b.getMsb() && a.getLsb() == b.getLsb();
+}
+
+LinkStats::LinkStats(LinkStatsEntry *entries, uint8_t size) : _pending(_pendingFrames, LINK_STATS_PENDING) {
+	_entries = entries;
+	_size = size;
+	clear();
+}
+
+void LinkStats::clear() {
+	_count = 0;
+	_unmatched = 0;
+	_pending.clear();
+}
+
+LinkStatsEntry* LinkStats::get(XBeeAddress64 &address) {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (sameAddress(_entries[i].address, address)) {
+			return &_entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+LinkStatsEntry* LinkStats::getOrAdd(XBeeAddress64 &address) {
+	LinkStatsEntry *entry = get(address);
+
+	if (entry == NULL) {
+		if (_count < _size) {
+			entry = &_entries[_count++];
+		} else if (_size > 0) {
+			// reuse the entry that was updated least recently
+			uint32_t now = millis();
+			entry = &_entries[0];
+
+			for (uint8_t i = 1; i < _count; i++) {
+				if (now - _entries[i].lastUpdate > now - entry->lastUpdate) {
+					entry = &_entries[i];
+				}
+			}
+		} else {
+			return NULL;
+		}
+
+		*entry = LinkStatsEntry();
+		entry->address = address;
+	}
+
+	entry->lastUpdate = millis();
+	return entry;
+}
+
+LinkStatsEntry* LinkStats::getWorst() {
+	LinkStatsEntry *worst = NULL;
+	uint16_t worstFailures = 0;
+	uint32_t worstRetries = 0;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		uint16_t failures = _entries[i].getFailures();
+		uint32_t retries = 0;
+
+		for (uint8_t r = 1; r < LINK_STATS_RETRY_BUCKETS; r++) {
+			retries += (uint32_t)r * _entries[i].retries[r];
+		}
+
+		if (failures > worstFailures || (failures == worstFailures && retries > worstRetries)) {
+			worst = &_entries[i];
+			worstFailures = failures;
+			worstRetries = retries;
+		}
+	}
+
+	return worst;
+}
+
+void LinkStats::onSend(XBeeRequest &request) {
+	if (request.getFrameId() == NO_RESPONSE_FRAME_ID) {
+		return;
+	}
+
+	XBeeAddress64 address;
+
+	if (getDestination(request, address)) {
+		_pending.add(request.getFrameId(), address, millis());
+	}
+}
+
+void LinkStats::addStatus(uint8_t frameId, uint8_t status, uint8_t retries, uint8_t discovery) {
+	XBeePendingFrame *pending = _pending.take(frameId);
+
+	if (pending == NULL) {
+		if (_unmatched != 0xffff) {
+			_unmatched++;
+		}
+
+		return;
+	}
+
+	uint32_t sent = pending->value;
+	LinkStatsEntry *entry = getOrAdd(pending->address);
+
+	if (entry == NULL) {
+		return;
+	}
+
+	increment(entry->txCount);
+	increment(entry->status[status]);
+
+	if (retries >= LINK_STATS_RETRY_BUCKETS) {
+		retries = LINK_STATS_RETRY_BUCKETS - 1;
+	}
+
+	increment(entry->retries[retries]);
+
+	if (discovery & 0x01) {
+		increment(entry->addressDiscoveries);
+	}
+
+	if (discovery & 0x02) {
+		increment(entry->routeDiscoveries);
+	}
+
+	if (discovery & 0x40) {
+		increment(entry->extendedTimeouts);
+	}
+
+	uint32_t latency = entry->lastUpdate - sent;
+
+	if (latency > 0xffff) {
+		latency = 0xffff;
+	}
+
+	if (entry->latencyCount != 0xffff) {
+		entry->latencyCount++;
+		entry->latencySum += latency;
+	}
+
+	if (latency > entry->latencyMax) {
+		entry->latencyMax = latency;
+	}
+}
+
+void LinkStats::addRx(XBeeAddress64 &address, uint8_t rssi) {
+	LinkStatsEntry *entry = getOrAdd(address);
+
+	if (entry == NULL) {
+		return;
+	}
+
+	increment(entry->rxCount);
+
+	if (rssi) {
+		uint16_t scaled = (uint16_t)rssi << 4;
+
+		if (entry->rssi == 0) {
+			entry->rssi = scaled;
+		} else {
+			entry->rssi += ((int16_t)(scaled - entry->rssi)) >> LINK_STATS_RSSI_SHIFT;
+		}
+	}
+}
+
+void LinkStats::onResponse(XBeeResponse &response) {
+	uint8_t id = response.getApiId();
+
+	if (id == ZB_TX_STATUS_RESPONSE) {
+		ZBTxStatusResponse status;
+		response.getZBTxStatusResponse(status);
+
+		uint8_t category;
+		switch (status.getDeliveryStatus()) {
+			case SUCCESS:
+			case INVALID_DESTINATION_ENDPOINT_SUCCESS:
+				category = LINK_STATS_DELIVERED;
+				break;
+			case 0x01:
+				category = LINK_STATS_MAC_ACK_FAILURE;
+				break;
+			case CCA_FAILURE:
+				category = LINK_STATS_CCA_FAILURE;
+				break;
+			case NETWORK_ACK_FAILURE:
+				category = LINK_STATS_NETWORK_ACK_FAILURE;
+				break;
+			case ROUTE_NOT_FOUND:
+				category = LINK_STATS_ROUTE_NOT_FOUND;
+				break;
+			case ADDRESS_NOT_FOUND:
+				category = LINK_STATS_ADDRESS_NOT_FOUND;
+				break;
+			default:
+				category = LINK_STATS_OTHER_FAILURE;
+				break;
+		}
+
+		addStatus(status.getFrameId(), category, status.getTxRetryCount(), status.getDiscoveryStatus());
+	} else if (id == TX_STATUS_RESPONSE) {
+		TxStatusResponse status;
+		response.getTxStatusResponse(status);
+
+		uint8_t category;
+		switch (status.getStatus()) {
+			case SUCCESS:
+				category = LINK_STATS_DELIVERED;
+				break;
+			case 0x01:
+				// no ACK received
+				category = LINK_STATS_MAC_ACK_FAILURE;
+				break;
+			case CCA_FAILURE:
+				category = LINK_STATS_CCA_FAILURE;
+				break;
+			default:
+				category = LINK_STATS_OTHER_FAILURE;
+				break;
+		}
+
+		addStatus(status.getFrameId(), category, 0, 0);
+	} else if (id == ZB_RX_RESPONSE || id == ZB_EXPLICIT_RX_RESPONSE || id == ZB_IO_SAMPLE_RESPONSE) {
+		// all of these start with the 64-bit source address
+		ZBRxResponse rx;
+		response.getZBRxResponse(rx);
+		addRx(rx.getRemoteAddress64(), 0);
+	} else if (id == RX_16_RESPONSE || id == RX_16_IO_RESPONSE) {
+		// the I/O sample responses have the same address and RSSI layout
+		Rx16Response rx;
+		response.getRx16Response(rx);
+		XBeeAddress64 address(0, rx.getRemoteAddress16());
+		addRx(address, rx.getRssi());
+	} else if (id == RX_64_RESPONSE || id == RX_64_IO_RESPONSE) {
+		Rx64Response rx;
+		response.getRx64Response(rx);
+		addRx(rx.getRemoteAddress64(), rx.getRssi());
+	}
+}
@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XBee_LinkStats_h
+#define XBee_LinkStats_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+// Retry count histogram buckets, the last one counts that many
+// retries or more
+#define LINK_STATS_RETRY_BUCKETS 4
+// Number of sent frames waiting for a TX status that are remembered,
+// raise it (e.g. with -DLINK_STATS_PENDING=16) when more frames are in
+// flight at once
+#ifndef LINK_STATS_PENDING
+#define LINK_STATS_PENDING 4
+#endif
+// Weight of a new RSSI reading is 1 / (1 << LINK_STATS_RSSI_SHIFT)
+#define LINK_STATS_RSSI_SHIFT 3
+
+// Delivery status categories, the index in LinkStatsEntry::status
+#define LINK_STATS_DELIVERED 0
+#define LINK_STATS_MAC_ACK_FAILURE 1
+#define LINK_STATS_CCA_FAILURE 2
+#define LINK_STATS_NETWORK_ACK_FAILURE 3
+#define LINK_STATS_ROUTE_NOT_FOUND 4
+#define LINK_STATS_ADDRESS_NOT_FOUND 5
+#define LINK_STATS_OTHER_FAILURE 6
+#define LINK_STATS_STATUS_COUNT 7
+
+/**
+ * Statistics about the link with one remote node. Counters stop at
+ * 0xffff instead of wrapping.
+ */
+struct LinkStatsEntry {
+	// Remote address, 16-bit addresses (Series 1) have a msb of 0
+	XBeeAddress64 address;
+	// millis() of the last update
+	uint32_t lastUpdate;
+	// Frames received from the node
+	uint16_t rxCount;
+	// TX statuses received for frames sent to the node
+	uint16_t txCount;
+	// TX statuses per LINK_STATS_* category
+	uint16_t status[LINK_STATS_STATUS_COUNT];
+	// TX statuses per retry count (ZB only)
+	uint16_t retries[LINK_STATS_RETRY_BUCKETS];
+	// TX statuses that needed address or route discovery or used an
+	// extended timeout (ZB only)
+	uint16_t addressDiscoveries;
+	uint16_t routeDiscoveries;
+	uint16_t extendedTimeouts;
+	// Average of the RSSI (-dBm) times 16, 0 when unknown (Series 1 only)
+	uint16_t rssi;
+	// Milliseconds between sending a frame and receiving its TX status
+	uint16_t latencyCount;
+	uint16_t latencyMax;
+	uint32_t latencySum;
+
+	/**
+	 * Returns the average RSSI in -dBm, like RxResponse::getRssi()
+	 */
+	uint8_t getRssi() const { return (rssi + 8) >> 4; }
+	uint16_t getFailures() const { return txCount - status[LINK_STATS_DELIVERED]; }
+	uint16_t getAverageLatency() const { return latencyCount ? latencySum / latencyCount : 0; }
+};
+
+/**
+ * Collects per-link statistics from the RSSI of received frames and
+ * the TX status of sent frames, in a table of entries supplied by the
+ * caller. When the table is full, the entry that was updated least
+ * recently is reused.
+ *
+ * TX statuses are matched to the destination of the request with the
+ * same frame id, so only frames sent with a frame id and through the
+ * XBee object the collector is registered with are counted. Only the
+ * last LINK_STATS_PENDING frames sent are remembered: when more frames
+ * wait for their TX status (e.g. a burst from a Mailbox), the oldest
+ * are forgotten, counted by getOverwritten(), and their statuses end
+ * up in getUnmatched().
+ *
+ * Example:
+ *
+ * LinkStatsEntry entries[8];
+ * LinkStats stats(entries, 8);
+ *
+ * void setup() {
+ *   xbee.addObserver(stats);
+ * }
+ *
+ * void report() {
+ *   LinkStatsEntry *worst = stats.getWorst();
+ *   if (worst)
+ *     printHex(Serial, worst->address);
+ * }
+ */
+class LinkStats : public XBeeObserver {
+public:
+	LinkStats(LinkStatsEntry *entries, uint8_t size);
+
+	void onSend(XBeeRequest &request);
+	void onResponse(XBeeResponse &response);
+
+	/**
+	 * Returns the entry for the given node, or NULL
+	 */
+	LinkStatsEntry* get(XBeeAddress64 &address);
+	/**
+	 * Entries in use are numbered from 0 to getCount() - 1
+	 */
+	uint8_t getCount() { return _count; }
+	LinkStatsEntry* getEntry(uint8_t index) { return index < _count ? &_entries[index] : NULL; }
+	/**
+	 * Returns the entry with the most failed deliveries, or if there
+	 * are none, the most retries. Returns NULL if no frames failed or
+	 * needed retries.
+	 */
+	LinkStatsEntry* getWorst();
+	/**
+	 * Number of TX statuses that did not match a sent frame
+	 */
+	uint16_t getUnmatched() { return _unmatched; }
+	/**
+	 * Number of sent frames forgotten before their TX status arrived,
+	 * because more than LINK_STATS_PENDING frames were waiting
+	 */
+	uint16_t getOverwritten() { return _pending.getOverwritten(); }
+	void clear();
+private:
+
+	LinkStatsEntry* getOrAdd(XBeeAddress64 &address);
+	void addStatus(uint8_t frameId, uint8_t status, uint8_t retries, uint8_t discovery);
+	void addRx(XBeeAddress64 &address, uint8_t rssi);
+
+	LinkStatsEntry* _entries;
+	uint8_t _size;
+	uint8_t _count;
+	XBeePendingFrame _pendingFrames[LINK_STATS_PENDING];
+	XBeePendingFrames _pending;
+	uint16_t _unmatched;
+};
+
+#endif // XBee_LinkStats_h
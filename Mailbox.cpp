@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Mailbox.h"
+
+#ifdef SERIES_2
+
+static void increment(uint16_t &counter) {
+	if (counter != 0xffff) {
+		counter++;
+	}
+}
+
+static bool sameAddress(XBeeAddress64 &a, XBeeAddress64 &b) {
+	return a.getMsb() == b.getMsb() && a.getLsb() == b.getLsb();
+}
+
+Mailbox::Mailbox(XBee &xbee, uint8_t *buffer, uint16_t size, uint32_t expiry) {
+	_xbee = &xbee;
+	_buffer = buffer;
+	_size = size;
+	_expiry = expiry;
+	_sent = 0;
+	_expired = 0;
+	_refused = 0;
+	clear();
+}
+
+void Mailbox::clear() {
+	_used = 0;
+	_awakeCount = 0;
+}
+
+void Mailbox::readHeader(uint16_t pos, Header &header) {
+	// records are not aligned
+	memcpy(&header, _buffer + pos, sizeof(Header));
+}
+
+void Mailbox::remove(uint16_t pos, uint16_t length) {
+	memmove(_buffer + pos, _buffer + pos + length, _used - pos - length);
+	_used -= length;
+}
+
+bool Mailbox::post(XBeeAddress64 &address, const uint8_t *payload, uint8_t length) {
+	if ((uint16_t)(_size - _used) < sizeof(Header) + length) {
+		increment(_refused);
+		return false;
+	}
+
+	Header header;
+	header.address = address;
+	header.time = millis();
+	header.length = length;
+
+	memcpy(_buffer + _used, &header, sizeof(Header));
+	memcpy(_buffer + _used + sizeof(Header), payload, length);
+	_used += sizeof(Header) + length;
+
+	return true;
+}
+
+bool Mailbox::isQueued(XBeeAddress64 &address) {
+	return getCount(address) > 0;
+}
+
+uint8_t Mailbox::getCount() {
+	uint8_t count = 0;
+	Header header;
+
+	for (uint16_t pos = 0; pos < _used; pos += sizeof(Header) + header.length) {
+		readHeader(pos, header);
+		count++;
+	}
+
+	return count;
+}
+
+uint8_t Mailbox::getCount(XBeeAddress64 &address) {
+	uint8_t count = 0;
+	Header header;
+
+	for (uint16_t pos = 0; pos < _used; pos += sizeof(Header) + header.length) {
+		readHeader(pos, header);
+
+		if (sameAddress(header.address, address)) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void Mailbox::clear(XBeeAddress64 &address) {
+	uint16_t pos = 0;
+	Header header;
+
+	while (pos < _used) {
+		readHeader(pos, header);
+
+		if (sameAddress(header.address, address)) {
+			remove(pos, sizeof(Header) + header.length);
+		} else {
+			pos += sizeof(Header) + header.length;
+		}
+	}
+}
+
+void Mailbox::onResponse(XBeeResponse &response) {
+	uint8_t id = response.getApiId();
+
+	if (id != ZB_RX_RESPONSE && id != ZB_EXPLICIT_RX_RESPONSE && id != ZB_IO_SAMPLE_RESPONSE) {
+		return;
+	}
+
+	// all of these start with the 64-bit source address
+	ZBRxResponse rx;
+	response.getZBRxResponse(rx);
+	XBeeAddress64 &address = rx.getRemoteAddress64();
+
+	for (uint8_t i = 0; i < _awakeCount; i++) {
+		if (sameAddress(_awake[i], address)) {
+			return;
+		}
+	}
+
+	// when full, the next frame from the node marks it again
+	if (_awakeCount < MAILBOX_AWAKE && isQueued(address)) {
+		_awake[_awakeCount++] = address;
+	}
+}
+
+uint8_t Mailbox::loop() {
+	uint8_t sent = 0;
+	uint16_t pos;
+	Header header;
+
+	if (_expiry) {
+		uint32_t now = millis();
+		pos = 0;
+
+		while (pos < _used) {
+			readHeader(pos, header);
+
+			if (now - header.time >= _expiry) {
+				remove(pos, sizeof(Header) + header.length);
+				increment(_expired);
+			} else {
+				pos += sizeof(Header) + header.length;
+			}
+		}
+	}
+
+	for (uint8_t i = 0; i < _awakeCount; i++) {
+		// encode the destination once for all its frames
+		ZBTxDestination destination(_awake[i]);
+		pos = 0;
+
+		while (pos < _used) {
+			readHeader(pos, header);
+
+			if (sameAddress(header.address, _awake[i])) {
+				_xbee->send(destination, _buffer + pos + sizeof(Header), header.length, _xbee->getNextFrameId());
+				remove(pos, sizeof(Header) + header.length);
+				increment(_sent);
+				sent++;
+			} else {
+				pos += sizeof(Header) + header.length;
+			}
+		}
+	}
+
+	_awakeCount = 0;
+
+	return sent;
+}
+
+#endif // SERIES_2
@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XBee_Mailbox_h
+#define XBee_Mailbox_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+#ifdef SERIES_2
+
+// Number of nodes that can be waiting to have their frames sent
+#define MAILBOX_AWAKE 4
+
+/**
+ * Queues frames for sleeping end devices on the coordinator (or a
+ * router) and sends them when the device shows it is awake, instead of
+ * sending them right away and having them expire in the buffer of the
+ * device's parent while it sleeps.
+ *
+ * A device is considered awake when a ZB RX, ZB explicit RX or ZB I/O
+ * sample frame is received from it, so the device should send
+ * something (e.g. its readings) when it wakes up. Its queued frames are
+ * then sent back-to-back as ZB TX requests, in the order they were
+ * posted, the next time loop() is called. Each gets a frame id from
+ * XBee::getNextFrameId().
+ *
+ * Frames are stored in a buffer supplied by the caller, taking 13 bytes
+ * plus the payload each (more on 32-bit platforms).
+ *
+ * Example:
+ *
+ * uint8_t mailboxBuffer[200];
+ * Mailbox mailbox(xbee, mailboxBuffer, sizeof(mailboxBuffer));
+ *
+ * void setup() {
+ *   xbee.addObserver(mailbox);
+ *   mailbox.post(sensorAddress, config, sizeof(config));
+ * }
+ *
+ * void loop() {
+ *   xbee.loop();
+ *   mailbox.loop();
+ * }
+ */
+class Mailbox : public XBeeObserver {
+public:
+	/**
+	 * Frames older than expiry milliseconds are dropped, 0 keeps them
+	 * until they are sent.
+	 */
+	Mailbox(XBee &xbee, uint8_t *buffer, uint16_t size, uint32_t expiry = 0);
+
+	void onResponse(XBeeResponse &response);
+
+	/**
+	 * Queues a frame with the given payload for the given node.
+	 * Returns false if there is no room left.
+	 */
+	bool post(XBeeAddress64 &address, const uint8_t *payload, uint8_t length);
+
+	/**
+	 * Sends the queued frames of nodes that woke up and drops expired
+	 * frames. Call this regularly, after XBeeWithCallbacks::loop() or
+	 * XBee::readPacket(). Returns the number of frames sent.
+	 */
+	uint8_t loop();
+
+	/**
+	 * Number of frames queued, in total or for one node
+	 */
+	uint8_t getCount();
+	uint8_t getCount(XBeeAddress64 &address);
+	/**
+	 * Drops the queued frames of one node, or all frames
+	 */
+	void clear(XBeeAddress64 &address);
+	void clear();
+
+	/**
+	 * Frames sent, expired and refused for lack of room. These stop at
+	 * 0xffff.
+	 */
+	uint16_t getSent() { return _sent; }
+	uint16_t getExpired() { return _expired; }
+	uint16_t getRefused() { return _refused; }
+private:
+	struct Header {
+		XBeeAddress64 address;
+		uint32_t time;
+		uint8_t length;
+	};
+
+	void readHeader(uint16_t pos, Header &header);
+	void remove(uint16_t pos, uint16_t length);
+	bool isQueued(XBeeAddress64 &address);
+
+	XBee* _xbee;
+	uint8_t* _buffer;
+	uint16_t _size;
+	uint16_t _used;
+	uint32_t _expiry;
+	XBeeAddress64 _awake[MAILBOX_AWAKE];
+	uint8_t _awakeCount;
+	uint16_t _sent;
+	uint16_t _expired;
+	uint16_t _refused;
+};
+
+#endif // SERIES_2
+
+#endif // XBee_Mailbox_h
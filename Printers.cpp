@@ -1,25 +1,139 @@
 #include "Printers.h"
 
+static const char hexDigits[16] PROGMEM = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+char hexDigit(uint8_t v) {
+	return pgm_read_byte(&hexDigits[v & 0xf]);
+}
+
+/**
+ * Helper function to format v as digits hex characters, most
+ * significant first.
+ */
+static void formatHex(char *out, uint32_t v, uint8_t digits) {
+	while (digits--) {
+		out[digits] = hexDigit(v);
+		v >>= 4;
+	}
+}
+
+/**
+ * Helper function to copy a separator from flash. Returns false when it
+ * does not fit, in which case it should be printed directly.
+ */
+static bool loadSeparator(char *out, uint8_t &len, uint8_t size, const __FlashStringHelper* sep) {
+	size_t n = sep ? strlen_P((const char*)sep) : 0;
+	if (n > size)
+		return false;
+	if (n)
+		memcpy_P(out, (const char*)sep, n);
+	len = n;
+	return true;
+}
+
 void printHex(Print& p, const uint8_t* buf, size_t len, const __FlashStringHelper* byte_sep, const __FlashStringHelper* group_sep, size_t group_by) {
+	// Format into a local chunk and write that in one go, instead of
+	// printing every digit and separator separately
+	char byteSep[4], groupSep[8], chunk[32];
+	uint8_t byteSepLen, groupSepLen, pos = 0;
+	bool byteSepLoaded = loadSeparator(byteSep, byteSepLen, sizeof(byteSep), byte_sep);
+	bool groupSepLoaded = loadSeparator(groupSep, groupSepLen, sizeof(groupSep), group_sep);
 	size_t cur_group = 0;
 	while (len--) {
+		if (pos + sizeof(groupSep) + sizeof(byteSep) + 2 > sizeof(chunk)) {
+			p.write((const uint8_t*)chunk, pos);
+			pos = 0;
+		}
+
 		// Print the group separator whenever starting a new
 		// group
 		if (group_by && group_sep && cur_group == group_by) {
-			p.print(group_sep);
+			if (groupSepLoaded) {
+				memcpy(chunk + pos, groupSep, groupSepLen);
+				pos += groupSepLen;
+			} else {
+				p.write((const uint8_t*)chunk, pos);
+				pos = 0;
+				p.print(group_sep);
+			}
 			cur_group = 0;
 		}
 
 		// Print the byte separator, except when at the start of
 		// a new group (this also excludes the first byte)
-		if (cur_group != 0 && byte_sep)
-			p.print(byte_sep);
+		if (cur_group != 0 && byte_sep) {
+			if (byteSepLoaded) {
+				memcpy(chunk + pos, byteSep, byteSepLen);
+				pos += byteSepLen;
+			} else {
+				p.write((const uint8_t*)chunk, pos);
+				pos = 0;
+				p.print(byte_sep);
+			}
+		}
 
-		printHex(p, *buf);
+		formatHex(chunk + pos, *buf, 2);
+		pos += 2;
 
 		buf++;
 		cur_group++;
 	}
+
+	if (pos)
+		p.write((const uint8_t*)chunk, pos);
+}
+
+void printHex(Print& p, uint8_t v) {
+	char out[2];
+	formatHex(out, v, sizeof(out));
+	p.write((const uint8_t*)out, sizeof(out));
+}
+
+void printHex(Print& p, uint16_t v) {
+	char out[4];
+	formatHex(out, v, sizeof(out));
+	p.write((const uint8_t*)out, sizeof(out));
+}
+
+void printHex(Print& p, uint32_t v) {
+	char out[8];
+	formatHex(out, v, sizeof(out));
+	p.write((const uint8_t*)out, sizeof(out));
+}
+
+void printHex(Print& p, XBeeAddress64 v) {
+	char out[16];
+	formatHex(out, v.getMsb(), 8);
+	formatHex(out + 8, v.getLsb(), 8);
+	p.write((const uint8_t*)out, sizeof(out));
+}
+
+size_t BufferedPrint::write(uint8_t b) {
+	if (_len == _size)
+		flush();
+	if (_size == 0)
+		return _target->write(b);
+	_buffer[_len++] = b;
+	return 1;
+}
+
+size_t BufferedPrint::write(const uint8_t *buf, size_t len) {
+	if (_len + len > _size) {
+		flush();
+		// Too big to buffer, pass it on directly
+		if (len > _size)
+			return _target->write(buf, len);
+	}
+	memcpy(_buffer + _len, buf, len);
+	_len += len;
+	return len;
+}
+
+void BufferedPrint::flush() {
+	if (_len) {
+		_target->write(_buffer, _len);
+		_len = 0;
+	}
 }
 
 void printErrorCb(uint8_t code, uintptr_t data) {
@@ -94,8 +208,10 @@ void printErrorCb(XBeeResponse& r, uintptr_t data) {
 
 
 void printRawResponseCb(XBeeResponse& response, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->print("Response: ");
 	// Reconstruct the original packet
 	uint8_t header[] = {START_BYTE, response.getMsbLength(), response.getLsbLength(), response.getApiId()};
@@ -119,8 +235,10 @@ static void printField(Print* p, const __FlashStringHelper *prefix, T data) {
 }
 
 void printResponseCb(ZBTxStatusResponse& status, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println(F("ZBTxStatusResponse:"));
 	printField(p, F("  FrameId: 0x"), status.getFrameId());
 	printField(p, F("  To: 0x"), status.getRemoteAddress());
@@ -129,8 +247,10 @@ void printResponseCb(ZBTxStatusResponse& status, uintptr_t data) {
 }
 
 void printResponseCb(ZBRxResponse& rx, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println(F("ZBRxResponse:"));
 	printField(p, F("  From: 0x"), rx.getRemoteAddress64());
 	printField(p, F("  From: 0x"), rx.getRemoteAddress16());
@@ -144,8 +264,10 @@ void printResponseCb(ZBRxResponse& rx, uintptr_t data) {
 }
 
 void printResponseCb(ZBExplicitRxResponse& rx, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println(F("ZBExplicitRxResponse:"));
 	printField(p, F("  From: 0x"), rx.getRemoteAddress64());
 	printField(p, F("  From: 0x"), rx.getRemoteAddress16());
@@ -163,8 +285,10 @@ void printResponseCb(ZBExplicitRxResponse& rx, uintptr_t data) {
 }
 
 void printResponseCb(ZBRxIoSampleResponse& rx, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println(F("ZBRxIoSampleResponse:"));
 	printField(p, F("  From: 0x"), rx.getRemoteAddress64());
 	printField(p, F("  From: 0x"), rx.getRemoteAddress16());
@@ -190,16 +314,20 @@ void printResponseCb(ZBRxIoSampleResponse& rx, uintptr_t data) {
 }
 
 void printResponseCb(TxStatusResponse& status, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println(F("TxStatusResponse:"));
 	printField(p, F("  FrameId: 0x"), status.getFrameId());
 	printField(p, F("  Status: 0x"), status.getStatus());
 }
 
 void printResponseCb(Rx16Response& rx, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println("Rx16Response:");
 	printField(p, F("  From: 0x"), rx.getRemoteAddress16());
 	printField(p, F("  Rssi: 0x"), rx.getRssi());
@@ -213,8 +341,10 @@ void printResponseCb(Rx16Response& rx, uintptr_t data) {
 }
 
 void printResponseCb(Rx64Response& rx, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println("Rx64Response:");
 	printField(p, F("  From: 0x"), rx.getRemoteAddress64());
 	printField(p, F("  Rssi: 0x"), rx.getRssi());
@@ -259,8 +389,10 @@ static void printSamples(Print* p, RxIoSampleBaseResponse& rx) {
 }
 
 void printResponseCb(Rx16IoSampleResponse& rx, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println("Rx16IoSampleResponse:");
 	printField(p, F("  From: 0x"), rx.getRemoteAddress16());
 	printField(p, F("  Rssi: 0x"), rx.getRssi());
@@ -270,8 +402,10 @@ void printResponseCb(Rx16IoSampleResponse& rx, uintptr_t data) {
 }
 
 void printResponseCb(Rx64IoSampleResponse& rx, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println("Rx64IoSampleResponse:");
 	printField(p, F("  From: 0x"), rx.getRemoteAddress64());
 	printField(p, F("  Rssi: 0x"), rx.getRssi());
@@ -281,15 +415,19 @@ void printResponseCb(Rx64IoSampleResponse& rx, uintptr_t data) {
 }
 
 void printResponseCb(ModemStatusResponse& status, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println("ModemStatusResponse:");
 	printField(p, F("  Status: 0x"), status.getStatus());
 }
 
 void printResponseCb(AtCommandResponse& at, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println("AtCommandResponse:");
 	p->print(F("  Command: "));
 	p->write(at.getCommand(), 2);
@@ -303,8 +441,10 @@ void printResponseCb(AtCommandResponse& at, uintptr_t data) {
 }
 
 void printResponseCb(RemoteAtCommandResponse& at, uintptr_t data) {
-	Print *p = (Print*)data;
-	if (!p) return;
+	if (!data) return;
+	uint8_t buf[PRINTERS_BUFFER_SIZE];
+	BufferedPrint out(*(Print*)data, buf, sizeof(buf));
+	Print *p = &out;
 	p->println("AtRemoteCommandResponse:");
 	printField(p, F("  To: 0x"), at.getRemoteAddress64());
 	printField(p, F("  To: 0x"), at.getRemoteAddress16());
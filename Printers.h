@@ -36,6 +36,12 @@ const char default_group_sep_arr[] PROGMEM = "\r\n";
 const __FlashStringHelper * const default_byte_sep = (const __FlashStringHelper*)default_byte_sep_arr;
 const __FlashStringHelper * const default_group_sep = (const __FlashStringHelper*)default_group_sep_arr;
 
+/**
+ * Returns the (uppercase) hex digit for the lowest 4 bits of v. The
+ * digits are stored in flash.
+ */
+char hexDigit(uint8_t v);
+
 /**
  * Print a buffer byte-by-byte. Each byte is separated by byte_sep and
  * every group_by bytes are separated by group_sep instead.
@@ -54,36 +60,58 @@ void printHex(Print& p, const uint8_t* buf, size_t len, const __FlashStringHelpe
 /**
  * Print a single byte, in hex, using a leading zero if needed.
  */
-inline void printHex(Print& p, uint8_t v) {
-	// Add leading zero if needed
-	if (v < 0x10)
-		p.write('0');
-	p.print(v, HEX);
-}
+void printHex(Print& p, uint8_t v);
 
 /**
  * Print a 16 bit integer, in hex, using leading zeroes if needed.
  */
-inline void printHex(Print& p, uint16_t v) {
-	printHex(p, (uint8_t)(v >> 8));
-	printHex(p, (uint8_t)v);
-}
+void printHex(Print& p, uint16_t v);
 
 /**
  * Print a 32 bit integer, in hex, using leading zeroes if needed.
  */
-inline void printHex(Print& p, uint32_t v) {
-	printHex(p, (uint16_t)(v >> 16));
-	printHex(p, (uint16_t)v);
-}
+void printHex(Print& p, uint32_t v);
 
 /**
  * Print a 64-bit address, in hex, using leading zeroes if needed.
  */
-inline void printHex(Print& p, XBeeAddress64 v) {
-	printHex(p, v.getMsb());
-	printHex(p, v.getLsb());
-}
+void printHex(Print& p, XBeeAddress64 v);
+
+// Size of the stack buffer the callbacks below format their output in
+#define PRINTERS_BUFFER_SIZE 64
+
+/**
+ * A Print that collects output in a buffer and passes it on to another
+ * Print in large writes, when the buffer is full, when flush() is
+ * called and when it goes out of scope. This helps when the target
+ * has a high per-call overhead.
+ *
+ * For example:
+ *
+ * uint8_t buf[64];
+ * BufferedPrint out(Serial, buf, sizeof(buf));
+ * printResponse(response, out);
+ * out.println(millis());
+ */
+class BufferedPrint : public Print {
+public:
+	BufferedPrint(Print &target, uint8_t *buffer, size_t size) : _target(&target), _buffer(buffer), _size(size), _len(0) {}
+	~BufferedPrint() { flush(); }
+
+	size_t write(uint8_t b);
+	size_t write(const uint8_t *buf, size_t len);
+	using Print::write;
+
+	/**
+	 * Passes any buffered output on to the target
+	 */
+	void flush();
+private:
+	Print* _target;
+	uint8_t* _buffer;
+	size_t _size;
+	size_t _len;
+};
 
 // The following functions are intended to be used as callbacks, to
 // print various information about received responses. All of the
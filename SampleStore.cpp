@@ -0,0 +1,450 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SampleStore.h"
+
+// Bookkeeping at the start of every node slot
+struct SampleStore::Node {
+	XBeeAddress64 address;
+	// time of the last sample, also used to evict the oldest node
+	uint32_t lastTime;
+	uint16_t digitalMask;
+	// previous readings in the current block, to encode differences
+	uint16_t prevDigital;
+	uint16_t prevAnalog[SAMPLE_STORE_MAX_ANALOG];
+	uint8_t analogMask;
+	uint8_t channels;
+	// number of blocks that fit in the slot, 0 for an unused slot
+	uint8_t blocks;
+	// block being written
+	uint8_t head;
+	// number of blocks containing samples
+	uint8_t used;
+	uint16_t blockSize;
+};
+
+// Header of every block, followed by one Summary per analog channel and
+// the encoded samples
+struct SampleStore::Block {
+	uint32_t start;
+	uint32_t end;
+	uint8_t count;
+	uint8_t length;
+};
+
+struct SampleStore::Summary {
+	uint16_t min;
+	uint16_t max;
+	uint16_t sum;
+};
+
+// Walks the samples encoded in a block
+struct Decoder {
+	const uint8_t *pos;
+	const uint8_t *end;
+	uint32_t time;
+	uint16_t digital;
+	uint16_t analog[SAMPLE_STORE_MAX_ANALOG];
+};
+
+// Round up to a multiple of 4, so structs in the buffer stay aligned
+static uint16_t align(uint16_t size) {
+	return (size + 3) & ~3;
+}
+
+static uint8_t putVarint(uint8_t *buf, uint32_t v) {
+	uint8_t n = 0;
+	while (v >= 0x80) {
+		buf[n++] = v | 0x80;
+		v >>= 7;
+	}
+	buf[n++] = v;
+	return n;
+}
+
+static uint32_t getVarint(const uint8_t *&pos) {
+	uint32_t v = 0;
+	uint8_t shift = 0;
+	uint8_t b;
+	do {
+		b = *pos++;
+		v |= (uint32_t)(b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return v;
+}
+
+// Map small negative and positive differences to small numbers
+static uint16_t zigzag(int16_t v) {
+	return ((uint16_t)v << 1) ^ (uint16_t)(v >> 15);
+}
+
+static int16_t unzigzag(uint16_t v) {
+	return (v >> 1) ^ -(int16_t)(v & 1);
+}
+
+// Number of analog pins enabled below the given pin
+static uint8_t channelIndex(uint8_t mask, uint8_t pin) {
+	uint8_t index = 0;
+	for (mask &= (1 << pin) - 1; mask; mask &= mask - 1) {
+		index++;
+	}
+	return index;
+}
+
+// Is t within [from, to], allowing for millis() overflow
+static bool inWindow(uint32_t t, uint32_t from, uint32_t to) {
+	return t - from <= to - from;
+}
+
+SampleStore::Summary* SampleStore::getSummaries(Block *block) {
+	return (Summary*)((uint8_t*)block + align(sizeof(Block)));
+}
+
+SampleStore::SampleStore(void *buffer, size_t size, uint8_t nodes, uint8_t blockData) {
+	size_t slotSize = nodes ? (size / nodes) & ~3 : 0;
+
+	_buffer = (uint8_t*)buffer;
+	_nodes = nodes;
+	_slotSize = slotSize > 0xfffc ? 0xfffc : slotSize;
+	_blockData = blockData;
+
+	if (!blockData || _slotSize < align(sizeof(Node)) + align(align(sizeof(Block)) + blockData)) {
+		// not even one block fits in a slot, leave the store empty
+		_nodes = 0;
+		_slotSize = 0;
+	}
+
+	clear();
+}
+
+void SampleStore::clear() {
+	for (uint8_t i = 0; i < _nodes; i++) {
+		((Node*)(_buffer + i * _slotSize))->blocks = 0;
+	}
+}
+
+SampleStore::Node* SampleStore::findNode(XBeeAddress64 &source) {
+	for (uint8_t i = 0; i < _nodes; i++) {
+		Node *node = (Node*)(_buffer + i * _slotSize);
+		if (node->blocks && node->address.getMsb() == source.getMsb() && node->address.getLsb() == source.getLsb()) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+SampleStore::Node* SampleStore::getNode(XBeeAddress64 &source, uint16_t digitalMask, uint8_t analogMask, uint32_t time) {
+	Node *node = findNode(source);
+
+	if (node && node->digitalMask == digitalMask && node->analogMask == analogMask) {
+		return node;
+	}
+
+	if (!node) {
+		// take a free slot, or evict the node that was quiet longest
+		for (uint8_t i = 0; i < _nodes; i++) {
+			Node *n = (Node*)(_buffer + i * _slotSize);
+			if (!n->blocks) {
+				node = n;
+				break;
+			}
+			if (!node || time - n->lastTime > time - node->lastTime) {
+				node = n;
+			}
+		}
+	}
+
+	if (!node) {
+		return NULL;
+	}
+
+	node->address = source;
+	node->digitalMask = digitalMask;
+	node->analogMask = analogMask;
+	node->channels = channelIndex(analogMask, 8);
+	node->blockSize = align(align(sizeof(Block)) + node->channels * sizeof(Summary) + _blockData);
+	uint16_t blocks = (_slotSize - align(sizeof(Node))) / node->blockSize;
+	node->blocks = blocks > 0xff ? 0xff : blocks;
+	node->head = 0;
+	node->used = 0;
+	node->lastTime = time;
+
+	if (node->channels > SAMPLE_STORE_MAX_ANALOG || !node->blocks) {
+		// does not fit, leave the slot unused
+		node->blocks = 0;
+		return NULL;
+	}
+
+	return node;
+}
+
+SampleStore::Block* SampleStore::getBlock(Node *node, uint8_t index) {
+	return (Block*)((uint8_t*)node + align(sizeof(Node)) + index * node->blockSize);
+}
+
+void SampleStore::startBlock(Node *node, uint32_t time) {
+	if (node->used) {
+		node->head = (node->head + 1) % node->blocks;
+	}
+	if (node->used < node->blocks) {
+		node->used++;
+	}
+
+	Block *block = getBlock(node, node->head);
+	Summary *summary = getSummaries(block);
+
+	block->start = time;
+	block->end = time;
+	block->count = 0;
+	block->length = 0;
+
+	for (uint8_t c = 0; c < node->channels; c++) {
+		summary[c].min = 0xffff;
+		summary[c].max = 0;
+		summary[c].sum = 0;
+		node->prevAnalog[c] = 0;
+	}
+
+	node->prevDigital = 0;
+	node->lastTime = time;
+}
+
+uint8_t SampleStore::encode(Node *node, uint16_t digital, const uint16_t *analog, uint32_t time, uint8_t *buf) {
+	uint8_t len = putVarint(buf, time - node->lastTime);
+
+	if (node->digitalMask) {
+		len += putVarint(buf + len, digital ^ node->prevDigital);
+	}
+
+	for (uint8_t c = 0; c < node->channels; c++) {
+		len += putVarint(buf + len, zigzag(analog[c] - node->prevAnalog[c]));
+	}
+
+	return len;
+}
+
+void SampleStore::add(XBeeAddress64 &source, uint16_t digitalMask, uint8_t analogMask, uint16_t digital, const uint16_t *analog, uint32_t time) {
+	// worst case: 5 byte time, 3 byte digital, 3 bytes per analog pin
+	uint8_t buf[5 + 3 + 3 * SAMPLE_STORE_MAX_ANALOG];
+	Node *node = getNode(source, digitalMask, analogMask, time);
+
+	if (!node) {
+		return;
+	}
+
+	if (!node->used) {
+		startBlock(node, time);
+	}
+
+	Block *block = getBlock(node, node->head);
+	uint8_t len = encode(node, digital, analog, time, buf);
+
+	if (block->count == SAMPLE_STORE_BLOCK_SAMPLES || block->length + len > _blockData) {
+		if (block->count) {
+			// start over from zero in a new block
+			startBlock(node, time);
+			block = getBlock(node, node->head);
+			len = encode(node, digital, analog, time, buf);
+		}
+		if (len > _blockData) {
+			// too big even for an empty block, drop it
+			return;
+		}
+	}
+
+	Summary *summary = getSummaries(block);
+	uint8_t *data = (uint8_t*)(summary + node->channels);
+
+	memcpy(data + block->length, buf, len);
+	block->length += len;
+	block->count++;
+	block->end = time;
+
+	for (uint8_t c = 0; c < node->channels; c++) {
+		if (analog[c] < summary[c].min) {
+			summary[c].min = analog[c];
+		}
+		if (analog[c] > summary[c].max) {
+			summary[c].max = analog[c];
+		}
+		summary[c].sum += analog[c];
+		node->prevAnalog[c] = analog[c];
+	}
+
+	node->prevDigital = digital;
+	node->lastTime = time;
+}
+
+#ifdef SERIES_2
+void SampleStore::add(ZBRxIoSampleResponse &rx, uint32_t time) {
+	ZBIoSample sample;
+	rx.getSample(sample);
+	add(rx.getRemoteAddress64(), sample.digitalMask, sample.analogMask, sample.digital, sample.analog, time);
+}
+#endif
+
+#ifdef SERIES_1
+/**
+ * Helper to add all samples of a Series 1 packet, turning the columns
+ * back into rows.
+ */
+static void addSamples(SampleStore &store, XBeeAddress64 &source, RxIoSampleBaseResponse &rx, uint32_t time) {
+	RxIoSamples samples;
+	uint16_t analog[SAMPLE_STORE_MAX_ANALOG];
+
+	rx.getSamples(samples);
+	// analog columns start after the digital column, if any
+	uint8_t first = samples.digitalMask ? samples.sampleCount : 0;
+
+	for (uint8_t s = 0; s < samples.sampleCount; s++) {
+		for (uint8_t c = 0; c < samples.analogCount; c++) {
+			analog[c] = samples.values[first + c * samples.sampleCount + s];
+		}
+		store.add(source, samples.digitalMask, samples.analogMask, samples.digitalMask ? samples.values[s] : 0, analog, time);
+	}
+}
+
+void SampleStore::add(Rx16IoSampleResponse &rx, uint32_t time) {
+	XBeeAddress64 source(0, rx.getRemoteAddress16());
+	addSamples(*this, source, rx, time);
+}
+
+void SampleStore::add(Rx64IoSampleResponse &rx, uint32_t time) {
+	addSamples(*this, rx.getRemoteAddress64(), rx, time);
+}
+#endif
+
+/**
+ * Prepare to decode a block, given its encoded samples.
+ */
+static void startDecoder(Decoder &dec, const uint8_t *data, uint8_t length, uint32_t start, uint8_t channels) {
+	dec.pos = data;
+	dec.end = data + length;
+	dec.time = start;
+	dec.digital = 0;
+	for (uint8_t c = 0; c < channels; c++) {
+		dec.analog[c] = 0;
+	}
+}
+
+/**
+ * Decode the next sample, returns false at the end of the block.
+ */
+static bool decodeNext(Decoder &dec, bool digital, uint8_t channels) {
+	if (dec.pos >= dec.end) {
+		return false;
+	}
+
+	dec.time += getVarint(dec.pos);
+	if (digital) {
+		dec.digital ^= getVarint(dec.pos);
+	}
+	for (uint8_t c = 0; c < channels; c++) {
+		dec.analog[c] += unzigzag(getVarint(dec.pos));
+	}
+	return true;
+}
+
+bool SampleStore::getStats(XBeeAddress64 &source, uint8_t pin, uint32_t from, uint32_t to, SampleStats &stats) {
+	Node *node = findNode(source);
+
+	stats.count = 0;
+	stats.min = 0xffff;
+	stats.max = 0;
+	stats.sum = 0;
+
+	if (!node || !node->used || !((node->analogMask >> pin) & 1)) {
+		return false;
+	}
+
+	uint8_t channel = channelIndex(node->analogMask, pin);
+
+	for (uint8_t i = 0; i < node->used; i++) {
+		Block *block = getBlock(node, (node->head + node->blocks - i) % node->blocks);
+		bool startIn = inWindow(block->start, from, to);
+		bool endIn = inWindow(block->end, from, to);
+
+		if (startIn && endIn) {
+			// block is completely inside the window, use the summary
+			Summary *summary = getSummaries(block) + channel;
+			if (summary->min < stats.min) {
+				stats.min = summary->min;
+			}
+			if (summary->max > stats.max) {
+				stats.max = summary->max;
+			}
+			stats.sum += summary->sum;
+			stats.count += block->count;
+		} else if (startIn || endIn || inWindow(from, block->start, block->end)) {
+			// block is on the edge of the window, check every sample
+			Decoder dec;
+			startDecoder(dec, (uint8_t*)(getSummaries(block) + node->channels), block->length, block->start, node->channels);
+			while (decodeNext(dec, node->digitalMask, node->channels)) {
+				if (!inWindow(dec.time, from, to)) {
+					continue;
+				}
+				uint16_t value = dec.analog[channel];
+				if (value < stats.min) {
+					stats.min = value;
+				}
+				if (value > stats.max) {
+					stats.max = value;
+				}
+				stats.sum += value;
+				stats.count++;
+			}
+		}
+	}
+
+	if (!stats.count) {
+		stats.min = 0;
+	}
+
+	return true;
+}
+
+uint16_t SampleStore::readSamples(XBeeAddress64 &source, uint32_t from, void (*func)(uint32_t, uint16_t, const uint16_t*, uint8_t, uintptr_t), uintptr_t data) {
+	Node *node = findNode(source);
+	uint16_t count = 0;
+
+	if (!node) {
+		return 0;
+	}
+
+	// oldest block first
+	for (uint8_t i = node->used; i > 0; i--) {
+		Block *block = getBlock(node, (node->head + node->blocks - (i - 1)) % node->blocks);
+		Decoder dec;
+
+		if (!inWindow(block->end, from, node->lastTime)) {
+			continue;
+		}
+
+		startDecoder(dec, (uint8_t*)(getSummaries(block) + node->channels), block->length, block->start, node->channels);
+		while (decodeNext(dec, node->digitalMask, node->channels)) {
+			if (inWindow(dec.time, from, node->lastTime)) {
+				func(dec.time, dec.digital, dec.analog, node->channels, data);
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XBee_SampleStore_h
+#define XBee_SampleStore_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+// Largest number of analog pins in any I/O sample (Series 1 ADC0-5)
+#define SAMPLE_STORE_MAX_ANALOG 6
+// Samples per block are limited so the per-block sum of 10-bit
+// readings fits in 16 bits
+#define SAMPLE_STORE_BLOCK_SAMPLES 64
+// Default number of encoded bytes per block
+#define SAMPLE_STORE_BLOCK_DATA 32
+
+/**
+ * Aggregate of the readings of one analog pin over a window.
+ */
+struct SampleStats {
+	uint16_t count;
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+
+	uint16_t getMean() const { return count ? sum / count : 0; }
+};
+
+/**
+ * Keeps a history of I/O samples per source address in a fixed amount
+ * of memory supplied by the caller.
+ *
+ * The memory is split into one slot per node. Inside a slot, samples
+ * are stored in a ring of blocks. Each sample is encoded as varints:
+ * the time since the previous sample, the digital readings XOR the
+ * previous ones and the zigzagged difference with the previous reading
+ * of each analog pin. Slowly changing sensors typically need 1 byte
+ * per value instead of 2. Every block starts from zero, so it can be
+ * decoded on its own, and keeps the min, max and sum of each analog pin,
+ * so window queries only need to decode the (at most two) blocks on the
+ * edges of the window.
+ *
+ * When the blocks of a node are full, the oldest block is overwritten.
+ * When all slots are taken and a new node sends samples, the node that
+ * was updated least recently is evicted. When the enabled pins of a
+ * node change, its history is cleared.
+ *
+ * Series 1 packets with multiple samples get the same timestamp for
+ * every sample, since the radio does not send sample times. Nodes sending
+ * Rx16IoSampleResponses are stored under a 64-bit address that has the
+ * 16-bit address as lsb and 0 as msb.
+ *
+ * Example, storing all ZB samples received and printing the mean of
+ * AD0 over the last minute:
+ *
+ * uint32_t storage[256];
+ * SampleStore store(storage, sizeof(storage), 4);
+ *
+ * void zbIoSample(ZBRxIoSampleResponse& rx, uintptr_t) {
+ *   store.add(rx);
+ *   SampleStats stats;
+ *   if (store.getStats(rx.getRemoteAddress64(), 0, 60000, stats))
+ *     Serial.println(stats.getMean());
+ * }
+ */
+class SampleStore {
+public:
+	/**
+	 * Creates a store in the given buffer, which must be aligned like
+	 * a uint32_t (e.g. declare it as a uint32_t array), split between
+	 * the given number of nodes. blockData is the number of encoded
+	 * bytes per block, bigger blocks have less overhead but make
+	 * window queries decode more. If nodes is 0 or a slot cannot hold
+	 * a single block, the store stays empty and ignores samples.
+	 */
+	SampleStore(void *buffer, size_t size, uint8_t nodes, uint8_t blockData = SAMPLE_STORE_BLOCK_DATA);
+
+#ifdef SERIES_2
+	void add(ZBRxIoSampleResponse &rx, uint32_t time = millis());
+#endif
+#ifdef SERIES_1
+	void add(Rx16IoSampleResponse &rx, uint32_t time = millis());
+	void add(Rx64IoSampleResponse &rx, uint32_t time = millis());
+#endif
+	/**
+	 * Adds a single sample. analog contains the readings of the
+	 * enabled analog pins in ascending pin order.
+	 */
+	void add(XBeeAddress64 &source, uint16_t digitalMask, uint8_t analogMask, uint16_t digital, const uint16_t *analog, uint32_t time);
+
+	/**
+	 * Aggregates the readings of the given analog pin of the given
+	 * node from time from up to and including time to. Returns false
+	 * if nothing is known about the node or pin.
+	 */
+	bool getStats(XBeeAddress64 &source, uint8_t pin, uint32_t from, uint32_t to, SampleStats &stats);
+
+	/**
+	 * Aggregates the readings of the last window milliseconds.
+	 */
+	bool getStats(XBeeAddress64 &source, uint8_t pin, uint32_t window, SampleStats &stats) {
+		uint32_t now = millis();
+		return getStats(source, pin, now - window, now, stats);
+	}
+
+	/**
+	 * Decodes all samples of the given node since time from, oldest
+	 * first, and calls func for each of them with the sample time,
+	 * the digital readings, the analog readings in ascending pin order
+	 * and the number of analog readings. Returns the number of
+	 * samples passed.
+	 */
+	uint16_t readSamples(XBeeAddress64 &source, uint32_t from, void (*func)(uint32_t, uint16_t, const uint16_t*, uint8_t, uintptr_t), uintptr_t data = 0);
+
+	/**
+	 * Forgets everything.
+	 */
+	void clear();
+private:
+	struct Node;
+	struct Block;
+	struct Summary;
+
+	static Summary* getSummaries(Block *block);
+
+	Node* findNode(XBeeAddress64 &source);
+	Node* getNode(XBeeAddress64 &source, uint16_t digitalMask, uint8_t analogMask, uint32_t time);
+	Block* getBlock(Node *node, uint8_t index);
+	void startBlock(Node *node, uint32_t time);
+	uint8_t encode(Node *node, uint16_t digital, const uint16_t *analog, uint32_t time, uint8_t *buf);
+
+	uint8_t *_buffer;
+	uint16_t _slotSize;
+	uint8_t _nodes;
+	uint8_t _blockData;
+};
+
+#endif // XBee_SampleStore_h
@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XBee_StaticFrames_h
+#define XBee_StaticFrames_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+// Building frames at compile time needs variadic templates
+#if __cplusplus >= 201103L
+
+/**
+ * A list of bytes, as template arguments.
+ */
+template <uint8_t... Bytes> struct XBeeByteList {};
+
+/**
+ * Stores the bytes of a list in flash (or rodata where there is no
+ * separate flash).
+ */
+template <typename List> struct XBeeByteArray;
+template <uint8_t... Bytes> struct XBeeByteArray<XBeeByteList<Bytes...> > {
+	static const uint8_t data[sizeof...(Bytes)];
+};
+template <uint8_t... Bytes> const uint8_t XBeeByteArray<XBeeByteList<Bytes...> >::data[sizeof...(Bytes)] PROGMEM = {Bytes...};
+
+// Sum of the given bytes, modulo 256
+constexpr uint8_t xbeeSum() { return 0; }
+template <typename... Tail> constexpr uint8_t xbeeSum(uint8_t head, Tail... tail) { return head + xbeeSum(tail...); }
+
+constexpr bool xbeeNeedsEscape(uint8_t b) { return b == START_BYTE || b == ESCAPE || b == XON || b == XOFF; }
+
+// Appends a byte to a list, escaping it if Escape is true
+template <bool Escape, uint8_t B, typename List> struct XBeeAppend;
+template <uint8_t B, uint8_t... Out> struct XBeeAppend<false, B, XBeeByteList<Out...> > {
+	typedef XBeeByteList<Out..., B> type;
+};
+template <uint8_t B, uint8_t... Out> struct XBeeAppend<true, B, XBeeByteList<Out...> > {
+	typedef XBeeByteList<Out..., ESCAPE, (uint8_t)(B ^ 0x20)> type;
+};
+
+// Appends the given bytes to List, escaped
+template <typename List, uint8_t... In> struct XBeeEscape {
+	typedef List type;
+};
+template <typename List, uint8_t Head, uint8_t... Tail> struct XBeeEscape<List, Head, Tail...> {
+	typedef typename XBeeEscape<typename XBeeAppend<xbeeNeedsEscape(Head), Head, List>::type, Tail...>::type type;
+};
+
+/**
+ * An API frame that is completely built at compile time: the length,
+ * checksum and escaping are all computed by the compiler and the
+ * frame bytes are stored in flash, so sending it is a single bulk
+ * write of constant bytes.
+ *
+ * The template arguments are the API ID followed by the frame data,
+ * starting with the frame id. Usually, one of the XBeeAtFrame or
+ * XBeeZBTxFrame aliases below is easier to use.
+ *
+ * Frames sent this way are not passed to XBeeObservers.
+ *
+ * This needs a C++11 compiler (Arduino 1.6.6 and later).
+ */
+template <uint8_t ApiId, uint8_t... FrameData>
+struct XBeeStaticFrame {
+	static const uint16_t LENGTH = 1 + sizeof...(FrameData);
+	static const uint8_t CHECKSUM = 0xff - xbeeSum(ApiId, FrameData...);
+
+	// The frame for API_MODE_UNESCAPED
+	typedef XBeeByteArray<XBeeByteList<START_BYTE, (uint8_t)(LENGTH >> 8), (uint8_t)LENGTH, ApiId, FrameData..., CHECKSUM> > Unescaped;
+	// The frame for API_MODE_ESCAPED, everything after the start byte is escaped
+	typedef XBeeByteArray<typename XBeeEscape<XBeeByteList<START_BYTE>, (uint8_t)(LENGTH >> 8), (uint8_t)LENGTH, ApiId, FrameData..., CHECKSUM>::type> Escaped;
+
+	/**
+	 * Sends the frame, in the API mode the XBee object is using.
+	 */
+	static void send(XBee &xbee) {
+		if (xbee.getApiMode() == API_MODE_ESCAPED)
+			xbee.sendFrame_P(Escaped::data, sizeof(Escaped::data));
+		else
+			xbee.sendFrame_P(Unescaped::data, sizeof(Unescaped::data));
+	}
+};
+
+/**
+ * A local AT command frame. For example, to query the serial number:
+ *
+ * typedef XBeeAtFrame<1, 'S', 'H'> ShQuery;
+ * ShQuery::send(xbee);
+ *
+ * Values to set follow the command, most significant byte first.
+ */
+template <uint8_t FrameId, uint8_t C1, uint8_t C2, uint8_t... Value>
+using XBeeAtFrame = XBeeStaticFrame<AT_COMMAND_REQUEST, FrameId, C1, C2, Value...>;
+
+/**
+ * A ZB TX request frame with a fixed destination and payload. For
+ * example, a heartbeat to the coordinator without a TX status:
+ *
+ * typedef XBeeZBTxFrame<NO_RESPONSE_FRAME_ID, 0, 0, ZB_BROADCAST_ADDRESS, ZB_BROADCAST_RADIUS_MAX_HOPS, ZB_TX_UNICAST, 'H', 'B'> Heartbeat;
+ * Heartbeat::send(xbee);
+ */
+template <uint8_t FrameId, uint32_t Msb, uint32_t Lsb, uint16_t Addr16, uint8_t Radius, uint8_t Option, uint8_t... Payload>
+using XBeeZBTxFrame = XBeeStaticFrame<ZB_TX_REQUEST, FrameId,
+	(uint8_t)(Msb >> 24), (uint8_t)(Msb >> 16), (uint8_t)(Msb >> 8), (uint8_t)Msb,
+	(uint8_t)(Lsb >> 24), (uint8_t)(Lsb >> 16), (uint8_t)(Lsb >> 8), (uint8_t)Lsb,
+	(uint8_t)(Addr16 >> 8), (uint8_t)Addr16, Radius, Option, Payload...>;
+
+#endif // __cplusplus >= 201103L
+
+#endif // XBee_StaticFrames_h
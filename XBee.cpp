@@ -27,6 +27,29 @@
 
 #include "HardwareSerial.h"
 
+#ifdef XBEE_COUNTERS
+// Adds the time between its construction and destruction to a counter
+struct XBeeCounterTimer {
+	uint32_t &_counter;
+	unsigned long _start;
+	XBeeCounterTimer(uint32_t &counter) : _counter(counter), _start(micros()) {}
+	~XBeeCounterTimer() { _counter += micros() - _start; }
+};
+
+#define XBEE_COUNT(counter) (_counters.counter++)
+#define XBEE_COUNT_TIME(counter) XBeeCounterTimer counterTimer(_counters.counter)
+#else
+#define XBEE_COUNT(counter) do {} while (0)
+#define XBEE_COUNT_TIME(counter) do {} while (0)
+#endif
+
+// Number of bits set in each nibble value
+static const uint8_t nibbleBits[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+static uint8_t countBits(uint8_t v) {
+	return nibbleBits[v & 0xf] + nibbleBits[v >> 4];
+}
+
 XBeeResponse::XBeeResponse() {
 
 }
@@ -283,6 +306,34 @@ bool ZBRxIoSampleResponse::isDigitalOn(uint8_t pin) {
 	}
 }
 
+void ZBRxIoSampleResponse::getSample(ZBIoSample &sample) {
+	uint8_t *data = getFrameData();
+	uint8_t len = getFrameDataLength();
+	// samples start after the masks, digital first
+	uint8_t pos = 15;
+
+	sample.digitalMask = ((uint16_t)(data[12] & 0x1c) << 8) | data[13];
+	sample.analogMask = data[14] & 0x8f;
+	sample.digital = 0;
+	sample.analogCount = 0;
+
+	if (sample.digitalMask && pos + 2 <= len) {
+		sample.digital = (((uint16_t)data[pos] << 8) | data[pos + 1]) & sample.digitalMask;
+		pos += 2;
+	}
+
+	// walk the enabled pins from low to high, clearing each one
+	for (uint8_t mask = sample.analogMask; mask && pos + 2 <= len; mask &= mask - 1) {
+		sample.analog[sample.analogCount++] = ((uint16_t)data[pos] << 8) | data[pos + 1];
+		pos += 2;
+	}
+}
+
+uint16_t ZBIoSample::getAnalog(uint8_t pin) const {
+	// position is the number of enabled pins before this one
+	return analog[countBits(analogMask & ((1 << pin) - 1))];
+}
+
 void XBeeResponse::getZBRxIoSampleResponse(XBeeResponse &response) {
 	ZBRxIoSampleResponse* zb = static_cast<ZBRxIoSampleResponse*>(&response);
 
@@ -495,6 +546,56 @@ bool RxIoSampleBaseResponse::isDigitalOn(uint8_t pin, uint8_t sample) {
 	}
 }
 
+void RxIoSampleBaseResponse::getSamples(RxIoSamples &samples) {
+	uint8_t *data = getFrameData();
+	uint8_t offset = getSampleOffset();
+	uint8_t len = getFrameDataLength();
+	// skip the 3-byte header (sample count and masks)
+	uint8_t pos = offset + 3;
+	uint8_t count = data[offset];
+
+	samples.digitalMask = ((uint16_t)(data[offset + 1] & 1) << 8) | data[offset + 2];
+	samples.analogMask = (data[offset + 1] >> 1) & 0x3f;
+	samples.analogCount = countBits(samples.analogMask);
+
+	uint8_t columns = samples.analogCount + (samples.digitalMask ? 1 : 0);
+
+	// never read past the end of the frame, whatever the count says
+	if (pos > len) {
+		count = 0;
+	} else if (columns && count > (len - pos) / (2 * columns)) {
+		count = (len - pos) / (2 * columns);
+	}
+	samples.sampleCount = count;
+
+	// samples are stored row by row in the frame, but column by column
+	// in the values array
+	for (uint8_t s = 0; s < count; s++) {
+		uint16_t *value = samples.values + s;
+		for (uint8_t c = 0; c < columns; c++) {
+			*value = ((uint16_t)data[pos] << 8) | data[pos + 1];
+			pos += 2;
+			value += count;
+		}
+	}
+
+	if (samples.digitalMask) {
+		for (uint8_t s = 0; s < count; s++) {
+			samples.values[s] &= samples.digitalMask;
+		}
+	}
+}
+
+const uint16_t* RxIoSamples::getAnalogColumn(uint8_t pin) const {
+	uint8_t column = countBits(analogMask & ((1 << pin) - 1));
+
+	if (digitalMask) {
+		// skip the digital column
+		column++;
+	}
+
+	return values + column * sampleCount;
+}
 
 //bool RxIoSampleBaseResponse::isDigital0On(uint8_t sample) {
 //	return isDigitalOn(0, sample);
@@ -777,7 +878,13 @@ void XBeeResponse::reset() {
 }
 
 void XBee::resetResponse() {
+	if (_streaming) {
+		_streaming = false;
+		_streamHandler->onEnd(STREAM_ABORTED);
+	}
+
 	_pos = 0;
+	_dataLimit = 0;
 	_escape = false;
 	_checksumTotal = 0;
 	_response.reset();
@@ -785,9 +892,20 @@ void XBee::resetResponse() {
 
 XBee::XBee(): _response(XBeeResponse()) {
         _pos = 0;
+        _dataLimit = 0;
         _escape = false;
         _checksumTotal = 0;
         _nextFrameId = 0;
+        _observers = NULL;
+        _streamHandler = NULL;
+        _idleFunc = NULL;
+        _idleData = 0;
+        _streaming = false;
+        _streamHeaderLength = 0;
+        _apiMode = ATAP;
+#ifdef XBEE_COUNTERS
+        resetCounters();
+#endif
 
         _response.init();
         _response.setFrameData(_responseFrameData);
@@ -799,6 +917,14 @@ XBee::XBee(): _response(XBeeResponse()) {
 #endif
 }
 
+void XBee::discardInput() {
+	while (available()) {
+		read();
+	}
+
+	resetResponse();
+}
+
 uint8_t XBee::getNextFrameId() {
 
 	_nextFrameId++;
@@ -820,11 +946,140 @@ void XBee::setSerial(Stream &serial) {
 	_serial = &serial;
 }
 
+#ifdef XBEE_COUNTERS
+void XBee::resetCounters() {
+	memset(&_counters, 0, sizeof(_counters));
+}
+
+uint8_t XBeeCounters::getIndex(uint8_t apiId) {
+	switch (apiId) {
+		case RX_64_RESPONSE: return 0;
+		case RX_16_RESPONSE: return 1;
+		case RX_64_IO_RESPONSE: return 2;
+		case RX_16_IO_RESPONSE: return 3;
+		case AT_RESPONSE: return 4;
+		case TX_STATUS_RESPONSE: return 5;
+		case MODEM_STATUS_RESPONSE: return 6;
+		case ZB_RX_RESPONSE: return 7;
+		case ZB_EXPLICIT_RX_RESPONSE: return 8;
+		case ZB_TX_STATUS_RESPONSE: return 9;
+		case ZB_IO_SAMPLE_RESPONSE: return 10;
+		case ZB_IO_NODE_IDENTIFIER_RESPONSE: return 11;
+		case REMOTE_AT_COMMAND_RESPONSE: return 12;
+		default: return XBEE_COUNTERS_API_IDS - 1;
+	}
+}
+#endif
+
+void XBee::setApiMode(uint8_t mode) {
+	_apiMode = mode;
+}
+
+uint8_t XBee::getApiMode() {
+	return _apiMode;
+}
+
+void XBee::addObserver(XBeeObserver &observer) {
+	observer._next = _observers;
+	_observers = &observer;
+}
+
+void XBee::removeObserver(XBeeObserver &observer) {
+	XBeeObserver **p = &_observers;
+
+	while (*p) {
+		if (*p == &observer) {
+			*p = observer._next;
+			observer._next = NULL;
+			return;
+		}
+
+		p = &(*p)->_next;
+	}
+}
+
+bool XBeeObserver::getDestination(XBeeRequest &request, XBeeAddress64 &address) {
+	switch (request.getApiId()) {
+		case ZB_TX_REQUEST:
+		case ZB_EXPLICIT_TX_REQUEST:
+		case TX_64_REQUEST:
+			address.setMsb(
+				((uint32_t)request.getFrameData(0) << 24) |
+				((uint32_t)request.getFrameData(1) << 16) |
+				((uint16_t)request.getFrameData(2) << 8) |
+				request.getFrameData(3));
+			address.setLsb(
+				((uint32_t)request.getFrameData(4) << 24) |
+				((uint32_t)request.getFrameData(5) << 16) |
+				((uint16_t)request.getFrameData(6) << 8) |
+				request.getFrameData(7));
+			return true;
+		case TX_16_REQUEST:
+			address.setMsb(0);
+			address.setLsb(((uint16_t)request.getFrameData(0) << 8) | request.getFrameData(1));
+			return true;
+		default:
+			return false;
+	}
+}
+
+XBeePendingFrames::XBeePendingFrames(XBeePendingFrame *frames, uint8_t size) {
+	_frames = frames;
+	_size = size;
+	clear();
+}
+
+void XBeePendingFrames::clear() {
+	_next = 0;
+	_overwritten = 0;
+
+	for (uint8_t i = 0; i < _size; i++) {
+		_frames[i].frameId = NO_RESPONSE_FRAME_ID;
+	}
+}
+
+void XBeePendingFrames::add(uint8_t frameId, XBeeAddress64 &address, uint32_t value) {
+	if (_size == 0) {
+		return;
+	}
+
+	XBeePendingFrame &p = _frames[_next];
+
+	if (p.frameId != NO_RESPONSE_FRAME_ID && _overwritten != 0xffff) {
+		// still waiting for the status of the oldest frame
+		_overwritten++;
+	}
+
+	p.address = address;
+	p.value = value;
+	p.frameId = frameId;
+	_next = (_next + 1) % _size;
+}
+
+XBeePendingFrame* XBeePendingFrames::take(uint8_t frameId) {
+	if (frameId == NO_RESPONSE_FRAME_ID) {
+		return NULL;
+	}
+
+	// search from the most recent send, in case frame ids wrapped
+	for (uint8_t n = 0; n < _size; n++) {
+		XBeePendingFrame &p = _frames[(_next + _size - 1 - n) % _size];
+
+		if (p.frameId == frameId) {
+			p.frameId = NO_RESPONSE_FRAME_ID;
+			return &p;
+		}
+	}
+
+	return NULL;
+}
+
 bool XBee::available() {
 	return _serial->available();
 }
 
 uint8_t XBee::read() {
+	XBEE_COUNT(bytesRead);
 	return _serial->read();
 }
 
@@ -851,6 +1106,10 @@ void XBee::readPacketUntilAvailable() {
 	while (!(getResponse().isAvailable() || getResponse().isError())) {
 		// read some more
 		readPacket();
+
+		if (_idleFunc && !(getResponse().isAvailable() || getResponse().isError()) && !available()) {
+			_idleFunc(XBEE_IDLE_NO_DEADLINE, _idleData);
+		}
 	}
 }
 
@@ -871,32 +1130,115 @@ bool XBee::readPacket(int timeout) {
      	} else if (getResponse().isError()) {
      		return false;
      	}
+
+     	idle(start, timeout);
     }
 
     // timed out
     return false;
 }
 
+void XBee::idle(unsigned long start, unsigned long timeout) {
+	if (_idleFunc == NULL || available()) {
+		return;
+	}
+
+	unsigned long elapsed = millis() - start;
+
+	if (elapsed < timeout) {
+		unsigned long remaining = timeout - elapsed;
+		_idleFunc(remaining < XBEE_IDLE_NO_DEADLINE ? remaining : XBEE_IDLE_NO_DEADLINE - 1, _idleData);
+	}
+}
+
+// Returns the length of the header before the payload of the RX
+// frames that can be streamed, 0 for others
+static uint8_t getStreamHeaderLength(uint8_t apiId) {
+	switch (apiId) {
+#ifdef SERIES_2
+		case ZB_RX_RESPONSE:
+			// 64-bit address, 16-bit address, options
+			return 11;
+		case ZB_EXPLICIT_RX_RESPONSE:
+			// plus endpoints, cluster and profile
+			return 17;
+#endif
+#ifdef SERIES_1
+		case RX_16_RESPONSE:
+			// 16-bit address, rssi, options
+			return 4;
+		case RX_64_RESPONSE:
+			// 64-bit address, rssi, options
+			return 10;
+#endif
+		default:
+			return 0;
+	}
+}
+
+void XBee::updateDataLimit() {
+	// the checksum
+	uint16_t limit = _response.getPacketLength() + 3;
+
+	// the first byte that does not fit
+	if (limit > MAX_FRAME_DATA_SIZE + 1) {
+		limit = MAX_FRAME_DATA_SIZE + 1;
+	}
+
+	// the last header byte of a frame that may be streamed
+	if (_streamHeaderLength && _streamHeaderLength + 3 < limit) {
+		limit = _streamHeaderLength + 3;
+	}
+
+	_dataLimit = _streaming ? 0 : limit;
+}
+
+void XBee::flushStream() {
+	if (_streamFill) {
+		_streamHandler->onData(_response.getFrameData() + _streamHeaderLength, _streamFill);
+		_streamFill = 0;
+	}
+}
+
 void XBee::readPacket() {
+	readPacketBytes(0xffff);
+}
+
+uint16_t XBee::readPacketBytes(uint16_t maxBytes) {
+	XBEE_COUNT_TIME(readPacketMicros);
+	uint16_t count = 0;
+
 	// reset previous response
 	if (_response.isAvailable() || _response.isError()) {
 		// discard previous packet and start over
 		resetResponse();
 	}
 
-    while (available()) {
+    while (count < maxBytes && available()) {
 
         b = read();
+        count++;
+
+		// in unescaped mode, the length field alone delimits the frame
+		if ((b == START_BYTE || b == ESCAPE) && _pos > 0 && _apiMode == API_MODE_ESCAPED) {
+			if (b == START_BYTE) {
+				// new packet start before previous packeted completed -- discard previous packet and start over
+				_response.setErrorCode(UNEXPECTED_START_BYTE);
+				XBEE_COUNT(unexpectedStartBytes);
+
+				if (_streaming) {
+					_streaming = false;
+					_streamHandler->onEnd(UNEXPECTED_START_BYTE);
+				}
 
-        if (_pos > 0 && b == START_BYTE && ATAP == 2) {
-        	// new packet start before previous packeted completed -- discard previous packet and start over
-        	_response.setErrorCode(UNEXPECTED_START_BYTE);
-        	return;
-        }
+				return count;
+			}
 
-		if (_pos > 0 && b == ESCAPE) {
-			if (available()) {
+			XBEE_COUNT(escapes);
+
+			if (count < maxBytes && available()) {
 				b = read();
+				count++;
 				b = 0x20 ^ b;
 			} else {
 				// escape byte.  next byte will be
@@ -910,6 +1252,16 @@ void XBee::readPacket() {
 			_escape = false;
 		}
 
+		if (_pos < _dataLimit) {
+			// a frame data byte that is not the first after the
+			// header of a streamed frame, nor the checksum, nor past
+			// the end of the array: only sum and store it
+			_checksumTotal += b;
+			_response.getFrameData()[_pos - 4] = b;
+			_pos++;
+			continue;
+		}
+
 		// checksum includes all bytes starting with api id
 		if (_pos >= API_ID_INDEX) {
 			_checksumTotal+= b;
@@ -938,19 +1290,46 @@ void XBee::readPacket() {
 				_response.setApiId(b);
 				_pos++;
 
+				_streamHeaderLength = _streamHandler ? getStreamHeaderLength(b) : 0;
+				updateDataLimit();
+
 				break;
 			default:
 				// starts at fifth byte
 
-				if (_pos > MAX_FRAME_DATA_SIZE) {
+				if (_pos > MAX_FRAME_DATA_SIZE && !_streaming) {
 					// exceed max size.  should never occur
 					_response.setErrorCode(PACKET_EXCEEDS_BYTE_ARRAY_LENGTH);
-					return;
+					XBEE_COUNT(oversizeFrames);
+					return count;
 				}
 
 				// check if we're at the end of the packet
 				// packet length does not include start, length, or checksum bytes, so add 3
 				if (_pos == (_response.getPacketLength() + 3)) {
+					if (_streaming) {
+						_streaming = false;
+
+						if ((_checksumTotal & 0xff) == 0xff) {
+							XBEE_COUNT(framesAccepted);
+							XBEE_COUNT(frames[XBeeCounters::getIndex(_response.getApiId())]);
+							_streamHandler->onEnd(NO_ERROR);
+						} else {
+							_response.setErrorCode(CHECKSUM_FAILURE);
+							XBEE_COUNT(checksumFailures);
+							_streamHandler->onEnd(CHECKSUM_FAILURE);
+						}
+
+						// the response is not available, so the next
+						// call does not reset the parser
+						_pos = 0;
+						_dataLimit = 0;
+						_escape = false;
+						_checksumTotal = 0;
+
+						return count;
+					}
+
 					// verify checksum
 
 					if ((_checksumTotal & 0xff) == 0xff) {
@@ -958,26 +1337,64 @@ void XBee::readPacket() {
 						_response.setAvailable(true);
 
 						_response.setErrorCode(NO_ERROR);
+						XBEE_COUNT(framesAccepted);
+						XBEE_COUNT(frames[XBeeCounters::getIndex(_response.getApiId())]);
 					} else {
 						// checksum failed
 						_response.setErrorCode(CHECKSUM_FAILURE);
+						XBEE_COUNT(checksumFailures);
 					}
 
 					// minus 4 because we start after start,msb,lsb,api and up to but not including checksum
 					// e.g. if frame was one byte, _pos=4 would be the byte, pos=5 is the checksum, where end stop reading
 					_response.setFrameLength(_pos - 4);
 
+					if (_response.isAvailable()) {
+						for (XBeeObserver *o = _observers; o; o = o->_next) {
+							o->onResponse(_response);
+						}
+					}
+
 					// reset state vars
 					_pos = 0;
+					_dataLimit = 0;
 
-					return;
+					return count;
+				} else if (_streaming) {
+					// collect payload after the header and pass it on in chunks
+					_response.getFrameData()[_streamHeaderLength + _streamFill++] = b;
+					_pos++;
+
+					if (_streamFill == XBEE_STREAM_CHUNK_SIZE || _pos == _response.getPacketLength() + 3 || !available()) {
+						flushStream();
+					}
 				} else {
 					// add to packet array, starting with the fourth byte of the apiFrame
 					_response.getFrameData()[_pos - 4] = b;
 					_pos++;
+
+					if (_streamHeaderLength && _pos - 4 == _streamHeaderLength) {
+						if (_response.getPacketLength() + 3 <= 0xff) {
+							// header complete, let the handler decide
+							_response.setFrameLength(_streamHeaderLength);
+
+							if (_streamHandler->onHeader(_response)) {
+								_streaming = true;
+								_streamFill = 0;
+							}
+						}
+
+						if (!_streaming) {
+							_streamHeaderLength = 0;
+						}
+
+						updateDataLimit();
+					}
 				}
         }
     }
+
+	return count;
 }
 
 // it's peanut butter jelly time!!
@@ -1019,6 +1436,8 @@ void XBeeRequest::setApiId(uint8_t apiId) {
 PayloadRequest::PayloadRequest(uint8_t apiId, uint8_t frameId, uint8_t *payload, uint8_t payloadLength) : XBeeRequest(apiId, frameId) {
 	_payloadPtr = payload;
 	_payloadLength = payloadLength;
+	_segments = NULL;
+	_segmentCount = 0;
 }
 
 uint8_t* PayloadRequest::getPayload() {
@@ -1027,6 +1446,8 @@ uint8_t* PayloadRequest::getPayload() {
 
 void PayloadRequest::setPayload(uint8_t* payload) {
 	_payloadPtr = payload;
+	_segments = NULL;
+	_segmentCount = 0;
 }
 
 uint8_t PayloadRequest::getPayloadLength() {
@@ -1037,6 +1458,43 @@ void PayloadRequest::setPayloadLength(uint8_t payloadLength) {
 	_payloadLength = payloadLength;
 }
 
+void PayloadRequest::setPayloadSegments(const PayloadSegment *segments, uint8_t count) {
+	_payloadPtr = NULL;
+	_segments = segments;
+	_segmentCount = count;
+	_segment = 0;
+	_segmentStart = 0;
+	_payloadLength = 0;
+
+	for (uint8_t i = 0; i < count; i++) {
+		_payloadLength += segments[i].length;
+	}
+}
+
+uint8_t PayloadRequest::getPayloadByte(uint8_t pos) {
+	if (_segments == NULL) {
+		return _payloadPtr[pos];
+	}
+
+	// start over when reading backwards
+	if (pos < _segmentStart) {
+		_segment = 0;
+		_segmentStart = 0;
+	}
+
+	// skip to the segment containing pos
+	while (_segment < _segmentCount && pos - _segmentStart >= _segments[_segment].length) {
+		_segmentStart += _segments[_segment].length;
+		_segment++;
+	}
+
+	if (_segment == _segmentCount) {
+		return 0;
+	}
+
+	return _segments[_segment].data[pos - _segmentStart];
+}
+
 #ifdef SERIES_2
 
 ZBTxRequest::ZBTxRequest() : PayloadRequest(ZB_TX_REQUEST, DEFAULT_FRAME_ID, NULL, 0) {
@@ -1085,7 +1543,7 @@ uint8_t ZBTxRequest::getFrameData(uint8_t pos) {
 	} else if (pos == 11) {
 		return _option;
 	} else {
-		return getPayload()[pos - ZB_TX_API_LENGTH];
+		return getPayloadByte(pos - ZB_TX_API_LENGTH);
 	}
 }
 
@@ -1173,7 +1631,7 @@ uint8_t ZBExplicitTxRequest::getFrameData(uint8_t pos) {
 	} else if (pos == 17) {
 		return _option;
 	} else {
-		return getPayload()[pos - ZB_EXPLICIT_TX_API_LENGTH];
+		return getPayloadByte(pos - ZB_EXPLICIT_TX_API_LENGTH);
 	}
 }
 
@@ -1212,6 +1670,60 @@ void ZBExplicitTxRequest::setClusterId(uint16_t clusterId) {
 void ZBExplicitTxRequest::setProfileId(uint16_t profileId) {
 	_profileId = profileId;
 }
+
+ZBTxDestination::ZBTxDestination(const XBeeAddress64 &addr64, uint16_t addr16, uint8_t broadcastRadius, uint8_t option) {
+	set(addr64, addr16, broadcastRadius, option);
+}
+
+void ZBTxDestination::set(const XBeeAddress64 &addr64, uint16_t addr16, uint8_t broadcastRadius, uint8_t option) {
+	XBeeAddress64 addr = addr64;
+
+	_raw[0] = (addr.getMsb() >> 24) & 0xff;
+	_raw[1] = (addr.getMsb() >> 16) & 0xff;
+	_raw[2] = (addr.getMsb() >> 8) & 0xff;
+	_raw[3] = addr.getMsb() & 0xff;
+	_raw[4] = (addr.getLsb() >> 24) & 0xff;
+	_raw[5] = (addr.getLsb() >> 16) & 0xff;
+	_raw[6] = (addr.getLsb() >> 8) & 0xff;
+	_raw[7] = addr.getLsb() & 0xff;
+	_raw[8] = (addr16 >> 8) & 0xff;
+	_raw[9] = addr16 & 0xff;
+	_raw[10] = broadcastRadius;
+	_raw[11] = option;
+
+	_checksum = ZB_TX_REQUEST;
+	_escapedLength = 0;
+
+	for (uint8_t i = 0; i < ZB_TX_API_LENGTH; i++) {
+		uint8_t b = _raw[i];
+		_checksum += b;
+
+		if (b == START_BYTE || b == ESCAPE || b == XON || b == XOFF) {
+			_escaped[_escapedLength++] = ESCAPE;
+			_escaped[_escapedLength++] = b ^ 0x20;
+		} else {
+			_escaped[_escapedLength++] = b;
+		}
+	}
+}
+
+XBeeAddress64 ZBTxDestination::getAddress64() {
+	return XBeeAddress64(
+		((uint32_t)_raw[0] << 24) | ((uint32_t)_raw[1] << 16) | ((uint16_t)_raw[2] << 8) | _raw[3],
+		((uint32_t)_raw[4] << 24) | ((uint32_t)_raw[5] << 16) | ((uint16_t)_raw[6] << 8) | _raw[7]);
+}
+
+uint16_t ZBTxDestination::getAddress16() {
+	return ((uint16_t)_raw[8] << 8) | _raw[9];
+}
+
+uint8_t ZBTxDestination::getBroadcastRadius() {
+	return _raw[10];
+}
+
+uint8_t ZBTxDestination::getOption() {
+	return _raw[11];
+}
 #endif
 
 #ifdef SERIES_1
@@ -1239,7 +1751,7 @@ uint8_t Tx16Request::getFrameData(uint8_t pos) {
 	} else if (pos == 2) {
 		return _option;
 	} else {
-		return getPayload()[pos - TX_16_API_LENGTH];
+		return getPayloadByte(pos - TX_16_API_LENGTH);
 	}
 }
 
@@ -1298,7 +1810,7 @@ uint8_t Tx64Request::getFrameData(uint8_t pos) {
 	} else if (pos == 8) {
 		return _option;
 	} else {
-		return getPayload()[pos - TX_64_API_LENGTH];
+		return getPayloadByte(pos - TX_64_API_LENGTH);
 	}
 }
 
@@ -1487,6 +1999,127 @@ uint8_t RemoteAtCommandRequest::getFrameDataLength() {
 	return REMOTE_AT_COMMAND_API_LENGTH + getCommandValueLength();
 }
 
+XBeeTxBuffer::XBeeTxBuffer(uint8_t *buffer, uint8_t size) : XBeeRequest(0, DEFAULT_FRAME_ID) {
+	_buffer = buffer;
+	_size = size;
+	_headerLength = 0;
+	_payloadLength = 0;
+}
+
+uint8_t* XBeeTxBuffer::begin(uint8_t apiId, uint8_t frameId, uint8_t headerLength) {
+	headerLength += XBEE_TX_BUFFER_FRAME_HEADER;
+
+	if (headerLength > _size) {
+		_headerLength = 0;
+		return NULL;
+	}
+
+	setApiId(apiId);
+	setFrameId(frameId);
+	_headerLength = headerLength;
+	_payloadLength = 0;
+
+	return _buffer + XBEE_TX_BUFFER_FRAME_HEADER;
+}
+
+static void putAddress64(uint8_t *p, const XBeeAddress64 &addr64) {
+	XBeeAddress64 addr = addr64;
+
+	p[0] = (addr.getMsb() >> 24) & 0xff;
+	p[1] = (addr.getMsb() >> 16) & 0xff;
+	p[2] = (addr.getMsb() >> 8) & 0xff;
+	p[3] = addr.getMsb() & 0xff;
+	p[4] = (addr.getLsb() >> 24) & 0xff;
+	p[5] = (addr.getLsb() >> 16) & 0xff;
+	p[6] = (addr.getLsb() >> 8) & 0xff;
+	p[7] = addr.getLsb() & 0xff;
+}
+
+#ifdef SERIES_2
+uint8_t* XBeeTxBuffer::beginZBTx(const XBeeAddress64 &addr64, uint16_t addr16, uint8_t broadcastRadius, uint8_t option, uint8_t frameId) {
+	uint8_t *p = begin(ZB_TX_REQUEST, frameId, ZB_TX_API_LENGTH);
+
+	if (p == NULL) {
+		return NULL;
+	}
+
+	putAddress64(p, addr64);
+	p[8] = (addr16 >> 8) & 0xff;
+	p[9] = addr16 & 0xff;
+	p[10] = broadcastRadius;
+	p[11] = option;
+
+	return getPayload();
+}
+
+uint8_t* XBeeTxBuffer::beginZBExplicitTx(const XBeeAddress64 &addr64, uint16_t addr16, uint8_t broadcastRadius, uint8_t option, uint8_t srcEndpoint, uint8_t dstEndpoint, uint16_t clusterId, uint16_t profileId, uint8_t frameId) {
+	uint8_t *p = begin(ZB_EXPLICIT_TX_REQUEST, frameId, ZB_EXPLICIT_TX_API_LENGTH);
+
+	if (p == NULL) {
+		return NULL;
+	}
+
+	putAddress64(p, addr64);
+	p[8] = (addr16 >> 8) & 0xff;
+	p[9] = addr16 & 0xff;
+	p[10] = srcEndpoint;
+	p[11] = dstEndpoint;
+	p[12] = (clusterId >> 8) & 0xff;
+	p[13] = clusterId & 0xff;
+	p[14] = (profileId >> 8) & 0xff;
+	p[15] = profileId & 0xff;
+	p[16] = broadcastRadius;
+	p[17] = option;
+
+	return getPayload();
+}
+#endif
+
+#ifdef SERIES_1
+uint8_t* XBeeTxBuffer::beginTx16(uint16_t addr16, uint8_t option, uint8_t frameId) {
+	uint8_t *p = begin(TX_16_REQUEST, frameId, TX_16_API_LENGTH);
+
+	if (p == NULL) {
+		return NULL;
+	}
+
+	p[0] = (addr16 >> 8) & 0xff;
+	p[1] = addr16 & 0xff;
+	p[2] = option;
+
+	return getPayload();
+}
+
+uint8_t* XBeeTxBuffer::beginTx64(const XBeeAddress64 &addr64, uint8_t option, uint8_t frameId) {
+	uint8_t *p = begin(TX_64_REQUEST, frameId, TX_64_API_LENGTH);
+
+	if (p == NULL) {
+		return NULL;
+	}
+
+	putAddress64(p, addr64);
+	p[8] = option;
+
+	return getPayload();
+}
+#endif
+
+void XBeeTxBuffer::setPayloadLength(uint8_t payloadLength) {
+	if (payloadLength > getMaxPayloadLength()) {
+		payloadLength = getMaxPayloadLength();
+	}
+
+	_payloadLength = payloadLength;
+}
+
+uint8_t XBeeTxBuffer::getFrameData(uint8_t pos) {
+	return _buffer[XBEE_TX_BUFFER_FRAME_HEADER + pos];
+}
+
+uint8_t XBeeTxBuffer::getFrameDataLength() {
+	return _headerLength - XBEE_TX_BUFFER_FRAME_HEADER + _payloadLength;
+}
+
 
 // TODO
 //GenericRequest::GenericRequest(uint8_t* frame, uint8_t len, uint8_t apiId): XBeeRequest(apiId, *(frame), len) {
@@ -1496,6 +2129,10 @@ uint8_t RemoteAtCommandRequest::getFrameDataLength() {
 void XBee::send(XBeeRequest &request) {
 	// the new new deal
 
+	for (XBeeObserver *o = _observers; o; o = o->_next) {
+		o->onSend(request);
+	}
+
 	sendByte(START_BYTE, false);
 
 	// send length
@@ -1527,9 +2164,110 @@ void XBee::send(XBeeRequest &request) {
 	sendByte(checksum, true);
 }
 
+#ifdef SERIES_2
+void XBee::send(ZBTxDestination &destination, const uint8_t *payload, uint8_t payloadLength, uint8_t frameId) {
+	if (_observers) {
+		// observers only know about requests
+		ZBTxRequest request(destination.getAddress64(), destination.getAddress16(), destination.getBroadcastRadius(), destination.getOption(), (uint8_t*)payload, payloadLength, frameId);
+
+		for (XBeeObserver *o = _observers; o; o = o->_next) {
+			o->onSend(request);
+		}
+	}
+
+	// api id, frame id, header and payload
+	uint16_t length = 2 + ZB_TX_API_LENGTH + payloadLength;
+
+	sendByte(START_BYTE, false);
+	sendByte((length >> 8) & 0xff, true);
+	sendByte(length & 0xff, true);
+	sendByte(ZB_TX_REQUEST, true);
+	sendByte(frameId, true);
+
+	if (_apiMode == API_MODE_ESCAPED) {
+		_serial->write(destination._escaped, destination._escapedLength);
+	} else {
+		_serial->write(destination._raw, ZB_TX_API_LENGTH);
+	}
+
+	uint8_t checksum = destination._checksum + frameId;
+
+	for (uint8_t i = 0; i < payloadLength; i++) {
+		sendByte(payload[i], true);
+		checksum += payload[i];
+	}
+
+	sendByte(0xff - checksum, true);
+}
+#endif
+
+void XBee::send(XBeeTxBuffer &buffer, uint8_t payloadLength) {
+	if (buffer._headerLength == 0) {
+		// no begin method called, or the buffer was too small
+		return;
+	}
+
+	buffer.setPayloadLength(payloadLength);
+
+	for (XBeeObserver *o = _observers; o; o = o->_next) {
+		o->onSend(buffer);
+	}
+
+	uint8_t *frame = buffer._buffer;
+	// api id, frame id, header and payload
+	uint16_t length = 2 + buffer.getFrameDataLength();
+	uint16_t end = 3 + length;
+
+	frame[0] = START_BYTE;
+	frame[1] = (length >> 8) & 0xff;
+	frame[2] = length & 0xff;
+	frame[3] = buffer.getApiId();
+	frame[4] = buffer.getFrameId();
+
+	uint8_t checksum = 0;
+
+	if (_apiMode == API_MODE_ESCAPED) {
+		sendByte(START_BYTE, false);
+
+		for (uint16_t i = 1; i < end; i++) {
+			sendByte(frame[i], true);
+
+			if (i >= 3) {
+				checksum += frame[i];
+			}
+		}
+	} else {
+		for (uint16_t i = 3; i < end; i++) {
+			checksum += frame[i];
+		}
+
+		_serial->write(frame, end);
+	}
+
+	sendByte(0xff - checksum, true);
+}
+
+void XBee::sendFrame(const uint8_t *frame, size_t length) {
+	_serial->write(frame, length);
+}
+
+void XBee::sendFrame_P(const uint8_t *frame, size_t length) {
+	// copy through a small buffer, so the serial port still gets
+	// large writes
+	uint8_t buf[16];
+
+	while (length) {
+		size_t n = length < sizeof(buf) ? length : sizeof(buf);
+		memcpy_P(buf, frame, n);
+		_serial->write(buf, n);
+		frame += n;
+		length -= n;
+	}
+}
+
 void XBee::sendByte(uint8_t b, bool escape) {
 
-	if (escape && (b == START_BYTE || b == ESCAPE || b == XON || b == XOFF)) {
+	if (escape && _apiMode == API_MODE_ESCAPED && (b == START_BYTE || b == ESCAPE || b == XON || b == XOFF)) {
 		write(ESCAPE);
 		write(b ^ 0x20);
 	} else {
@@ -1538,23 +2276,56 @@ void XBee::sendByte(uint8_t b, bool escape) {
 }
 
 
+XBeeWithCallbacks::XBeeWithCallbacks() {
+	_filter = NULL;
+}
+
 void XBeeWithCallbacks::loop() {
 	if (loopTop())
 		loopBottom();
 }
 
+uint8_t XBeeWithCallbacks::step(uint16_t maxBytes, uint8_t maxFrames) {
+	uint8_t frames = 0;
+
+	while (frames < maxFrames && maxBytes > 0) {
+		uint16_t count = readPacketBytes(maxBytes);
+
+		if (handleResponse()) {
+			loopBottom();
+			frames++;
+		}
+
+		if (count == 0 || count >= maxBytes)
+			break;
+
+		maxBytes -= count;
+	}
+
+	return frames;
+}
+
 bool XBeeWithCallbacks::loopTop() {
 	readPacket();
+	return handleResponse();
+}
+
+bool XBeeWithCallbacks::handleResponse() {
 	if (getResponse().isAvailable()) {
-		_onResponse.call(getResponse());
+		if (_filter && _filter->reject(getResponse()))
+			return false;
+		if (_onResponse.call(getResponse()))
+			XBEE_COUNT(callbacks);
 		return true;
 	} else if (getResponse().isError()) {
-		_onPacketError.call(getResponse().getErrorCode());
+		if (_onPacketError.call(getResponse().getErrorCode()))
+			XBEE_COUNT(callbacks);
 	}
 	return false;
 }
 
 void XBeeWithCallbacks::loopBottom() {
+	XBEE_COUNT_TIME(loopBottomMicros);
 	bool called = false;
 	uint8_t id = getResponse().getApiId();
 
@@ -1609,7 +2380,10 @@ void XBeeWithCallbacks::loopBottom() {
 	}
 
 	if (!called)
-		_onOtherResponse.call(getResponse());
+		called = _onOtherResponse.call(getResponse());
+
+	if (called)
+		XBEE_COUNT(callbacks);
 }
 
 uint8_t XBeeWithCallbacks::matchStatus(uint8_t frameId) {
@@ -1763,6 +2537,8 @@ uint8_t XBeeWithCallbacks::waitForInternal(uint8_t apiId, void *response, uint16
 			}
 			// Call regular callbacks
 			loopBottom();
+		} else {
+			idle(start, timeout);
 		}
 	} while (millis() - start < timeout);
 	return XBEE_WAIT_TIMEOUT;
@@ -1778,8 +2554,127 @@ uint8_t XBeeWithCallbacks::waitForStatus(uint8_t frameId, uint16_t timeout) {
 
 			// Call regular callbacks
 			loopBottom();
+		} else {
+			idle(start, timeout);
 		}
 	} while (millis() - start < timeout);
 	return XBEE_WAIT_TIMEOUT ;
 }
 
+
+// Standard baud rates, indexed by their BD value
+static const uint32_t baudRates[] PROGMEM = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400};
+#define BAUD_RATE_COUNT (sizeof(baudRates) / sizeof(*baudRates))
+// BD value of 9600 baud, the factory default
+#define DEFAULT_BAUD_INDEX 3
+
+static bool matchFrameId(AtCommandResponse& response, uintptr_t frameId) {
+	return response.getFrameId() == frameId;
+}
+
+bool XBeeWithCallbacks::queryApiMode(uint16_t timeout) {
+	uint8_t cmd[] = {'A', 'P'};
+	AtCommandRequest request(cmd);
+	AtCommandResponse response;
+
+	// With frame id 1, neither this request nor its response contain
+	// bytes that need escaping, so this works in both API modes
+	request.setFrameId(1);
+
+	discardInput();
+	send(request);
+
+	if (waitFor(response, timeout, matchFrameId, 1, 1) != 0 || response.getValueLength() < 1)
+		return false;
+
+	uint8_t mode = response.getValue()[response.getValueLength() - 1];
+	if (mode != API_MODE_UNESCAPED && mode != API_MODE_ESCAPED)
+		return false;
+
+	setApiMode(mode);
+	return true;
+}
+
+uint8_t XBeeWithCallbacks::sendBaud(uint32_t baud, uint16_t timeout) {
+	uint8_t cmd[] = {'B', 'D'};
+	uint8_t value[4];
+	uint8_t len = 0;
+
+	// Standard rates are set by index, others by value
+	for (uint8_t i = 0; i < BAUD_RATE_COUNT; i++) {
+		if (pgm_read_dword(&baudRates[i]) == baud) {
+			value[len++] = i;
+			break;
+		}
+	}
+
+	if (len == 0) {
+		value[len++] = baud >> 24;
+		value[len++] = baud >> 16;
+		value[len++] = baud >> 8;
+		value[len++] = baud;
+	}
+
+	AtCommandRequest request(cmd, value, len);
+	request.setFrameId(getNextFrameId());
+	return sendAndWait(request, timeout);
+}
+
+uint32_t XBeeWithCallbacks::probe(void (*setBaud)(uint32_t, uintptr_t), uintptr_t data, uint16_t timeout) {
+	// Try the factory default first, then the others from fast to slow
+	for (int8_t i = BAUD_RATE_COUNT; i >= 0; i--) {
+		if (i == DEFAULT_BAUD_INDEX)
+			continue;
+
+		uint8_t index = (i == BAUD_RATE_COUNT) ? DEFAULT_BAUD_INDEX : i;
+		uint32_t baud = pgm_read_dword(&baudRates[index]);
+		setBaud(baud, data);
+
+		if (queryApiMode(timeout))
+			return baud;
+	}
+
+	return 0;
+}
+
+uint32_t XBeeWithCallbacks::raiseBaud(void (*setBaud)(uint32_t, uintptr_t), uint32_t current, uint32_t maxBaud, uintptr_t data, uint16_t timeout) {
+	for (int8_t i = BAUD_RATE_COUNT - 1; i >= 0; i--) {
+		uint32_t baud = pgm_read_dword(&baudRates[i]);
+
+		if (baud > maxBaud)
+			continue;
+
+		if (baud <= current)
+			break;
+
+		// The radio answers at the old rate and switches afterwards.
+		// Without an answer, it might still have switched, so check.
+		uint8_t status = sendBaud(baud, timeout);
+		if (status != AT_OK && status != XBEE_WAIT_TIMEOUT)
+			continue;
+
+		setBaud(baud, data);
+
+		if (queryApiMode(timeout) || queryApiMode(timeout))
+			return baud;
+
+		// No answer at the new rate, try to switch the radio back
+		// in case it did switch but the link is unreliable
+		sendBaud(current, timeout);
+		setBaud(current, data);
+
+		if (!queryApiMode(timeout) && !queryApiMode(timeout))
+			return probe(setBaud, data, timeout);
+	}
+
+	return current;
+}
+
+uint32_t XBeeWithCallbacks::bringUp(void (*setBaud)(uint32_t, uintptr_t), uint32_t maxBaud, uintptr_t data, uint16_t timeout) {
+	uint32_t baud = probe(setBaud, data, timeout);
+
+	if (baud && maxBaud > baud)
+		baud = raiseBaud(setBaud, baud, maxBaud, data, timeout);
+
+	return baud;
+}
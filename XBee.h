@@ -31,9 +31,19 @@
 #define SERIES_1
 #define SERIES_2
 
-// set to ATAP value of XBee. AP=2 is recommended
+// set to ATAP value of XBee. AP=2 is recommended. This is the default
+// for XBee::setApiMode()
 #define ATAP 2
 
+// API modes for XBee::setApiMode()
+#define API_MODE_UNESCAPED 1
+#define API_MODE_ESCAPED 2
+
+// Uncomment to count what the parser and callbacks are doing, see
+// XBee::getCounters(). When this is not defined, the counters take no
+// memory or time at all.
+//#define XBEE_COUNTERS
+
 #define START_BYTE 0x7e
 #define ESCAPE 0x7d
 #define XON 0x11
@@ -125,6 +135,11 @@
 #define PAYLOAD_TOO_LARGE 0x74
 // Returned by XBeeWithCallbacks::waitForStatus on timeout
 #define XBEE_WAIT_TIMEOUT 0xff
+// Remaining time passed to the idle handler when there is no deadline
+#define XBEE_IDLE_NO_DEADLINE 0xffff
+
+// Default time to wait for an answer when probing the radio, in ms
+#define XBEE_PROBE_TIMEOUT 150
 
 // modem status
 #define HARDWARE_RESET 0
@@ -150,6 +165,9 @@
 #define CHECKSUM_FAILURE 1
 #define PACKET_EXCEEDS_BYTE_ARRAY_LENGTH 2
 #define UNEXPECTED_START_BYTE 3
+// only passed to XBeeStreamHandler::onEnd(), when a streamed frame is
+// abandoned by XBee::discardInput()
+#define STREAM_ABORTED 4
 
 /**
  * C++11 introduced the constexpr as a hint to the compiler that things
@@ -397,6 +415,82 @@ public:
 // we maintain a pointer to each type of response, when a response is parsed, it is allocated only if NULL
 // can we allocate an object in a function?
 
+#ifdef SERIES_2
+// ZB I/O samples can contain AD0-3 and the supply voltage
+#define ZB_IO_MAX_ANALOG 5
+// index of the supply voltage in the ZB analog mask
+#define ZB_IO_SUPPLY_VOLTAGE 7
+
+/**
+ * All values of a Series 2 I/O sample, decoded in a single pass by
+ * ZBRxIoSampleResponse::getSample(). Reading pins from this struct does
+ * not need to look at the frame again.
+ */
+struct ZBIoSample {
+	// bit n is set when DIOn is enabled (DIO0-7 and DIO10-12)
+	uint16_t digitalMask;
+	// bit n is set when ADn is enabled (AD0-3, bit 7 is the supply voltage)
+	uint8_t analogMask;
+	// bit n is set when DIOn is high. Bits of disabled pins are 0
+	uint16_t digital;
+	// number of valid entries in analog
+	uint8_t analogCount;
+	// 10-bit readings of the enabled analog pins, in ascending pin order
+	uint16_t analog[ZB_IO_MAX_ANALOG];
+
+	bool isDigitalEnabled(uint8_t pin) const { return (digitalMask >> pin) & 1; }
+	bool isDigitalOn(uint8_t pin) const { return (digital >> pin) & 1; }
+	bool isAnalogEnabled(uint8_t pin) const { return (analogMask >> pin) & 1; }
+	/**
+	 * Returns the reading of the given analog pin, which must be enabled
+	 */
+	uint16_t getAnalog(uint8_t pin) const;
+};
+#endif
+
+#ifdef SERIES_1
+// Series 1 I/O samples can contain ADC0-5
+#define RX_IO_MAX_ANALOG 6
+// every value in a sample takes two bytes of frame data, so this always fits
+#define RX_IO_MAX_VALUES (MAX_FRAME_DATA_SIZE / 2)
+
+/**
+ * All samples of a Series 1 I/O sample packet, decoded in a single pass
+ * by RxIoSampleBaseResponse::getSamples().
+ *
+ * The values are stored in a column-per-pin layout: when digital pins
+ * are enabled, the first sampleCount values are the digital readings of
+ * each sample, followed by a column of sampleCount values for each
+ * enabled analog pin, in ascending pin order.
+ */
+struct RxIoSamples {
+	// bit n is set when DIOn is enabled (DIO0-8)
+	uint16_t digitalMask;
+	// bit n is set when ADCn is enabled (ADC0-5)
+	uint8_t analogMask;
+	// number of samples decoded
+	uint8_t sampleCount;
+	// number of enabled analog pins (and analog columns)
+	uint8_t analogCount;
+	uint16_t values[RX_IO_MAX_VALUES];
+
+	bool isDigitalEnabled(uint8_t pin) const { return (digitalMask >> pin) & 1; }
+	bool isAnalogEnabled(uint8_t pin) const { return (analogMask >> pin) & 1; }
+	/**
+	 * Returns the digital readings of all samples (bit n set means DIOn
+	 * high), or NULL if no digital pins are enabled.
+	 */
+	const uint16_t* getDigitalColumn() const { return digitalMask ? values : NULL; }
+	/**
+	 * Returns the readings of the given analog pin for all samples. The
+	 * pin must be enabled.
+	 */
+	const uint16_t* getAnalogColumn(uint8_t pin) const;
+	bool isDigitalOn(uint8_t pin, uint8_t sample) const { return (values[sample] >> pin) & 1; }
+	uint16_t getAnalog(uint8_t pin, uint8_t sample) const { return getAnalogColumn(pin)[sample]; }
+};
+#endif
+
 #ifdef SERIES_2
 /**
  * Represents a Series 2 TX status packet
@@ -481,6 +575,11 @@ public:
 	uint8_t getDigitalMaskMsb();
 	uint8_t getDigitalMaskLsb();
 	uint8_t getAnalogMask();
+	/**
+	 * Decodes the masks and all pin values at once. This is cheaper
+	 * than calling the methods above for each pin.
+	 */
+	void getSample(ZBIoSample &sample);
 
 	static const uint8_t API_ID = ZB_IO_SAMPLE_RESPONSE;
 };
@@ -580,6 +679,11 @@ class RxIoSampleBaseResponse : public RxResponse {
 		 * Gets the offset of the start of the given sample.
 		 */
 		uint8_t getSampleStart(uint8_t sample);
+		/**
+		 * Decodes the masks and all samples at once. This is cheaper
+		 * than calling the methods above for each pin and sample.
+		 */
+		void getSamples(RxIoSamples &samples);
 	private:
 };
 
@@ -737,12 +841,168 @@ private:
 	uint8_t _frameId;
 };
 
+#ifdef XBEE_COUNTERS
+// Number of API IDs counted separately in XBeeCounters::frames
+#define XBEE_COUNTERS_API_IDS 14
+
+/**
+ * Parser and dispatch counters, see XBee::getCounters()
+ */
+struct XBeeCounters {
+	// Bytes read from the serial port
+	uint32_t bytesRead;
+	// Escape sequences in received frames
+	uint32_t escapes;
+	// Frames with a valid checksum
+	uint32_t framesAccepted;
+	// Accepted frames per API ID, use getFrames() to read these
+	uint16_t frames[XBEE_COUNTERS_API_IDS];
+	uint16_t checksumFailures;
+	uint16_t unexpectedStartBytes;
+	uint16_t oversizeFrames;
+	// Callbacks called by XBeeWithCallbacks::loop()
+	uint32_t callbacks;
+	// Total time spent in readPacket() and loopBottom(), in micros
+	uint32_t readPacketMicros;
+	uint32_t loopBottomMicros;
+
+	/**
+	 * Returns the number of accepted frames with the given API ID.
+	 * Frames with API IDs that this library does not know are counted
+	 * together, under any unknown API ID.
+	 */
+	uint16_t getFrames(uint8_t apiId) const { return frames[getIndex(apiId)]; }
+	static uint8_t getIndex(uint8_t apiId);
+};
+#endif
+
+/**
+ * Base class for modules that want to see all traffic of an XBee
+ * object, such as statistics collectors. Override the methods you need
+ * and register the observer with XBee::addObserver().
+ *
+ * onSend() is called by XBee::send() before the frame is written,
+ * onResponse() is called by XBee::readPacket() for every valid
+ * response, before any callbacks. Observers should return quickly and
+ * must not send or read packets themselves.
+ */
+class XBeeObserver {
+public:
+	XBeeObserver() : _next(NULL) {}
+	virtual void onSend(XBeeRequest &) {}
+	virtual void onResponse(XBeeResponse &) {}
+protected:
+	/**
+	 * Fills address with the destination of a TX request (ZB, explicit,
+	 * 16-bit or 64-bit). 16-bit addresses are returned with a msb of 0.
+	 * Returns false for other requests.
+	 */
+	static bool getDestination(XBeeRequest &request, XBeeAddress64 &address);
+private:
+	XBeeObserver* _next;
+	friend class XBee;
+};
+
+/**
+ * A sent frame waiting for its status, see XBeePendingFrames
+ */
+struct XBeePendingFrame {
+	// Usually the destination of the frame
+	XBeeAddress64 address;
+	// Kept for the observer, e.g. the millis() when it was sent
+	uint32_t value;
+	uint8_t frameId;
+};
+
+/**
+ * Remembers the last frames sent with a frame id, so an XBeeObserver
+ * can match the status responses with them, in a table supplied by
+ * the caller. When the table is full, the oldest frame is forgotten
+ * and counted by getOverwritten().
+ */
+class XBeePendingFrames {
+public:
+	XBeePendingFrames(XBeePendingFrame *frames, uint8_t size);
+
+	void add(uint8_t frameId, XBeeAddress64 &address, uint32_t value);
+	/**
+	 * Returns the most recently sent frame with the given id and
+	 * forgets it, or NULL. The frame stays valid until the next add().
+	 */
+	XBeePendingFrame* take(uint8_t frameId);
+	/**
+	 * Number of frames forgotten before their status arrived
+	 */
+	uint16_t getOverwritten() { return _overwritten; }
+	void clear();
+private:
+	XBeePendingFrame* _frames;
+	uint8_t _size;
+	uint8_t _next;
+	uint16_t _overwritten;
+};
+
+/**
+ * Decides whether XBeeWithCallbacks handles a response at all, see
+ * XBeeWithCallbacks::setResponseFilter(). reject() is called for every
+ * valid response before any callbacks, return true to drop it.
+ */
+class XBeeResponseFilter {
+public:
+	virtual bool reject(XBeeResponse &response) = 0;
+};
+
+// Default limits of XBeeWithCallbacks::step()
+#define XBEE_STEP_BYTES 512
+#define XBEE_STEP_FRAMES 8
+
+// Payload bytes collected before XBeeStreamHandler::onData() is called,
+// when more bytes are available right away
+#define XBEE_STREAM_CHUNK_SIZE 32
+
+/**
+ * Receives RX data frames (ZB RX, ZB explicit RX, RX16 and RX64) while
+ * they are being read, instead of after the whole frame is buffered.
+ * Register it with XBee::setStreamHandler().
+ *
+ * onHeader() is called once the header of the frame (everything before
+ * the payload) is read, with a response that can be converted as usual
+ * (e.g. getZBExplicitRxResponse()) to get the source address, endpoints,
+ * cluster and the total payload length (getDataLength()), but not the
+ * data itself. Return true to stream the frame, false to have it
+ * buffered and returned by readPacket() as usual.
+ *
+ * For a streamed frame, onData() is then called with the payload in
+ * chunks of up to XBEE_STREAM_CHUNK_SIZE bytes as they arrive, and
+ * onEnd() with NO_ERROR if the checksum is correct, or an error code.
+ * Data passed to onData() is not verified until onEnd(), so be
+ * prepared to throw it away.
+ *
+ * Streamed frames are never made available by readPacket() and are not
+ * passed to observers, a checksum failure is reported as usual. Since
+ * only the header and one chunk are kept, streamed frames can be longer
+ * than MAX_FRAME_DATA_SIZE (up to 255 bytes including the start byte,
+ * length and api id).
+ */
+class XBeeStreamHandler {
+public:
+	virtual bool onHeader(XBeeResponse &header) = 0;
+	virtual void onData(const uint8_t *data, uint8_t length) = 0;
+	virtual void onEnd(uint8_t errorCode) = 0;
+};
+
+#ifdef SERIES_2
+class ZBTxDestination;
+#endif
+class XBeeTxBuffer;
+
 // TODO add reset/clear method since responses are often reused
 /**
  * Primary interface for communicating with an XBee Radio.
  * This class provides methods for sending and receiving packets with an XBee radio via the serial port.
- * The XBee radio must be configured in API (packet) mode (AP=2)
- * in order to use this software.
+ * The XBee radio must be configured in API (packet) mode (AP=2, or
+ * AP=1 after calling setApiMode(API_MODE_UNESCAPED)) in order to use
+ * this software.
  * <p/>
  * Since this code is designed to run on a microcontroller, with only one thread, you are responsible for reading the
  * data off the serial buffer in a timely manner.  This involves a call to a variant of readPacket(...).
@@ -775,6 +1035,13 @@ public:
 	 * current response
 	 */
 	void readPacket();
+	/**
+	 * Like readPacket(), but also returns after reading maxBytes
+	 * bytes, with the packet incomplete, so the time spent is bounded
+	 * even when a lot of data is waiting. Returns the number of bytes
+	 * read, 0 when nothing was available.
+	 */
+	uint16_t readPacketBytes(uint16_t maxBytes);
 	/**
 	 * Waits a maximum of <i>timeout</i> milliseconds for a response packet before timing out; returns true if packet is read.
 	 * Returns false if timeout or error occurs.
@@ -800,15 +1067,109 @@ public:
 	 * Sends a XBeeRequest (TX packet) out the serial port
 	 */
 	void send(XBeeRequest &request);
+	/**
+	 * Sends a complete, already escaped (depending on the API mode)
+	 * frame, including start byte, length and checksum, in a single
+	 * write. See XBeeStaticFrame for building these at compile time.
+	 * Observers are not told about frames sent this way.
+	 */
+	void sendFrame(const uint8_t *frame, size_t length);
+	/**
+	 * Like sendFrame(), for a frame stored in PROGMEM.
+	 */
+	void sendFrame_P(const uint8_t *frame, size_t length);
+#ifdef SERIES_2
+	/**
+	 * Sends a ZB TX request with the given payload to a prepared
+	 * destination. This sends the same frame as a ZBTxRequest would,
+	 * but with less work per frame.
+	 */
+	void send(ZBTxDestination &destination, const uint8_t *payload, uint8_t payloadLength, uint8_t frameId = DEFAULT_FRAME_ID);
+#endif
+	/**
+	 * Sends the frame prepared in the given buffer, with the first
+	 * payloadLength bytes of its payload. This fills in the length and
+	 * computes the checksum while sending, see XBeeTxBuffer.
+	 */
+	void send(XBeeTxBuffer &buffer, uint8_t payloadLength);
 	//uint8_t sendAndWaitForResponse(XBeeRequest &request, int timeout);
 	/**
 	 * Returns a sequential frame id between 1 and 255
 	 */
 	uint8_t getNextFrameId();
+	/**
+	 * Discards all received bytes that were not read yet, as well as
+	 * any partially received packet.
+	 */
+	void discardInput();
 	/**
 	 * Specify the serial port.  Only relevant for Arduinos that support multiple serial ports (e.g. Mega)
 	 */
 	void setSerial(Stream &serial);
+	/**
+	 * Sets the API mode the radio is configured with (its AP value),
+	 * API_MODE_ESCAPED (the default, unless ATAP is changed) or
+	 * API_MODE_UNESCAPED. In unescaped mode, frames are sent without
+	 * escaping and received frames are delimited by their length
+	 * field only. This saves bytes on the wire for binary payloads,
+	 * but a start byte in the data of a corrupted frame can no longer
+	 * be told from a real one, so use it on reliable links only.
+	 */
+	void setApiMode(uint8_t mode);
+	uint8_t getApiMode();
+	/**
+	 * Registers an observer that is told about every request sent and
+	 * response received. An observer can only be registered with one
+	 * XBee object at a time.
+	 */
+	void addObserver(XBeeObserver &observer);
+	void removeObserver(XBeeObserver &observer);
+	/**
+	 * Sets the handler RX data frames are streamed to, see
+	 * XBeeStreamHandler. Pass NULL to buffer all frames again.
+	 */
+	void setStreamHandler(XBeeStreamHandler *handler) { _streamHandler = handler; }
+	/**
+	 * Sets a function that is called by readPacket(int),
+	 * readPacketUntilAvailable() and the waitFor methods of
+	 * XBeeWithCallbacks whenever they are waiting and no serial data
+	 * is available. It receives the milliseconds left until the wait
+	 * times out (XBEE_IDLE_NO_DEADLINE from readPacketUntilAvailable())
+	 * and data. It can put the MCU to sleep until the next interrupt
+	 * (the UART receive interrupt or the millis() timer), or yield to
+	 * other tasks, as long as it returns when data arrives or the time
+	 * is up. Without it, waiting is a busy loop. Pass NULL to remove it.
+	 *
+	 * Example, on AVR:
+	 *
+	 * void sleepIdle(uint16_t remaining, uintptr_t) {
+	 *   set_sleep_mode(SLEEP_MODE_IDLE);
+	 *   sleep_mode();
+	 * }
+	 */
+	void setIdleHandler(void (*func)(uint16_t, uintptr_t), uintptr_t data = 0) {
+		_idleFunc = func;
+		_idleData = data;
+	}
+#ifdef XBEE_COUNTERS
+	/**
+	 * Copies the current counter values into counters
+	 */
+	void getCounters(XBeeCounters &counters) { counters = _counters; }
+	/**
+	 * Sets all counters to zero
+	 */
+	void resetCounters();
+protected:
+	XBeeCounters _counters;
+#endif
+protected:
+	/**
+	 * Calls the idle handler, if any, when no data is available and
+	 * the wait that started at start and lasts timeout milliseconds is
+	 * not over yet.
+	 */
+	void idle(unsigned long start, unsigned long timeout);
 private:
 	bool available();
 	uint8_t read();
@@ -816,17 +1177,33 @@ private:
 	void write(uint8_t val);
 	void sendByte(uint8_t b, bool escape);
 	void resetResponse();
+	void flushStream();
+	void updateDataLimit();
 	XBeeResponse _response;
 	bool _escape;
 	// current packet position for response.  just a state variable for packet parsing and has no relevance for the response otherwise
 	uint8_t _pos;
+	// frame data bytes before this position only need to be summed and
+	// stored, 0 outside of frame data
+	uint8_t _dataLimit;
 	// last byte read
 	uint8_t b;
 	uint8_t _checksumTotal;
 	uint8_t _nextFrameId;
+	uint8_t _apiMode;
 	// buffer for incoming RX packets.  holds only the api specific frame data, starting after the api id byte and prior to checksum
 	uint8_t _responseFrameData[MAX_FRAME_DATA_SIZE];
 	Stream* _serial;
+	XBeeObserver* _observers;
+	XBeeStreamHandler* _streamHandler;
+	void (*_idleFunc)(uint16_t, uintptr_t);
+	uintptr_t _idleData;
+	// true while the payload of the current frame is streamed
+	bool _streaming;
+	// header length of the current frame if it can be streamed, else 0
+	uint8_t _streamHeaderLength;
+	// payload bytes in _responseFrameData after the header
+	uint8_t _streamFill;
 };
 
 
@@ -870,6 +1247,7 @@ private:
  */
 class XBeeWithCallbacks : public XBee {
 public:
+	XBeeWithCallbacks();
 
 	/**
 	 * Register a packet error callback. It is called whenever an
@@ -922,12 +1300,28 @@ public:
 	void onAtCommandResponse(void (*func)(AtCommandResponse&, uintptr_t), uintptr_t data = 0) { _onAtCommandResponse.set(func, data); }
 	void onRemoteAtCommandResponse(void (*func)(RemoteAtCommandResponse&, uintptr_t), uintptr_t data = 0) { _onRemoteAtCommandResponse.set(func, data); }
 
+	/**
+	 * Sets a filter that can drop responses before any callbacks are
+	 * called (including onResponse and the waitFor methods), e.g. a
+	 * DuplicateFilter. Pass NULL to remove it.
+	 */
+	void setResponseFilter(XBeeResponseFilter *filter) { _filter = filter; }
+
 	/**
 	 * Regularly call this method, which ensures that the serial
 	 * buffer is processed and the appropriate callbacks are called.
 	 */
 	void loop();
 
+	/**
+	 * Like loop(), for use in an event loop (e.g. when a FdStream is
+	 * readable): handles up to maxFrames responses, reading at most
+	 * maxBytes bytes, and returns as soon as no more bytes are
+	 * available without waiting. Returns the number of responses
+	 * handled.
+	 */
+	uint8_t step(uint16_t maxBytes = XBEE_STEP_BYTES, uint8_t maxFrames = XBEE_STEP_FRAMES);
+
 	/**
 	 * Wait for a API response of the given type, optionally
 	 * filtered by the given match function.
@@ -996,7 +1390,60 @@ public:
 	 * retrieved using getResponse() as normal.
 	 */
 	uint8_t waitForStatus(uint8_t frameId, uint16_t timeout);
+
+	/**
+	 * Finds the baud rate and API mode the radio is using, by trying
+	 * the standard baud rates (9600 first) until the radio answers an
+	 * AP query, and then calls setApiMode() with the answer.
+	 *
+	 * Since a Stream cannot change its baud rate, setBaud is called
+	 * with each rate to try, along with the data parameter. It should
+	 * reconfigure the serial port, for example:
+	 *
+	 * void setBaud(uint32_t baud, uintptr_t) { Serial1.begin(baud); }
+	 *
+	 * Returns the baud rate found, or 0 when the radio did not answer
+	 * (e.g. because it is not in API mode at all).
+	 */
+	uint32_t probe(void (*setBaud)(uint32_t, uintptr_t), uintptr_t data = 0, uint16_t timeout = XBEE_PROBE_TIMEOUT);
+
+	/**
+	 * Raises the baud rate of the radio (BD) from current to the
+	 * highest standard rate up to maxBaud it accepts, and reconfigures
+	 * the serial port to match using setBaud (see probe()). A new
+	 * rate is only kept when the radio answers at it. Otherwise, the
+	 * old rate is restored and the next lower rate is tried. If the
+	 * radio cannot be found at the old rate either, probe() is used to
+	 * find it again.
+	 *
+	 * The new rate is not written to non-volatile memory, so the radio
+	 * goes back to its configured rate when it is reset. Use probe() at
+	 * startup to find it.
+	 *
+	 * Returns the baud rate in use afterwards, or 0 when the radio was
+	 * lost (resetting the radio brings it back to its configured rate).
+	 */
+	uint32_t raiseBaud(void (*setBaud)(uint32_t, uintptr_t), uint32_t current, uint32_t maxBaud, uintptr_t data = 0, uint16_t timeout = XBEE_PROBE_TIMEOUT);
+
+	/**
+	 * Brings up the serial link: calls probe() and, if maxBaud is
+	 * higher than the rate found, raiseBaud(). Returns the baud rate
+	 * in use, or 0 when the radio was not found.
+	 */
+	uint32_t bringUp(void (*setBaud)(uint32_t, uintptr_t), uint32_t maxBaud = 0, uintptr_t data = 0, uint16_t timeout = XBEE_PROBE_TIMEOUT);
 private:
+	/**
+	 * Helper for probe() and raiseBaud(). Queries AP and switches to
+	 * the API mode returned. Returns true if the radio answered.
+	 */
+	bool queryApiMode(uint16_t timeout);
+
+	/**
+	 * Helper for raiseBaud(). Sends a BD command for the given rate,
+	 * returns the command status.
+	 */
+	uint8_t sendBaud(uint32_t baud, uint16_t timeout);
+
 	/**
 	 * Internal version of waitFor that does not need to be
 	 * templated (to prevent duplication the implementation for
@@ -1018,11 +1465,17 @@ private:
 	/**
 	 * Top half of a typical loop(). Calls readPacket(), calls
 	 * onPacketError on error, calls onResponse when a response is
-	 * available. Returns in the true in the latter case, after
+	 * available and not rejected by the response filter. Returns in
+	 * the true in the latter case, after
 	 * which a caller should typically call loopBottom().
 	 */
 	bool loopTop();
 
+	/**
+	 * The part of loopTop() after readPacket()
+	 */
+	bool handleResponse();
+
 	/**
 	 * Bottom half of a typical loop. Call only when a valid
 	 * response was read, will call all response-specific callbacks.
@@ -1060,6 +1513,16 @@ private:
 	Callback<ModemStatusResponse&> _onModemStatusResponse;
 	Callback<AtCommandResponse&> _onAtCommandResponse;
 	Callback<RemoteAtCommandResponse&> _onRemoteAtCommandResponse;
+	XBeeResponseFilter *_filter;
+};
+
+/**
+ * One piece of a payload sent from several buffers, see
+ * PayloadRequest::setPayloadSegments()
+ */
+struct PayloadSegment {
+	const uint8_t *data;
+	uint8_t length;
 };
 
 /**
@@ -1095,9 +1558,35 @@ public:
 	 * Length must be <= to the array length.
 	 */
 	void setPayloadLength(uint8_t payloadLength);
+	/**
+	 * Sends the payload from count segments, in order, instead of one
+	 * array, e.g. an application header and a body kept in separate
+	 * buffers. Nothing is copied, so the segments array and the data it
+	 * points to must stay valid until the request is sent. The payload
+	 * length is set to the total length of the segments, which must not
+	 * be more than 255, and getPayload() returns NULL until setPayload()
+	 * is called again.
+	 */
+	void setPayloadSegments(const PayloadSegment *segments, uint8_t count);
+	/**
+	 * Returns the segments set with setPayloadSegments(), or NULL
+	 */
+	const PayloadSegment* getPayloadSegments() { return _segments; }
+	uint8_t getPayloadSegmentCount() { return _segmentCount; }
+	/**
+	 * Returns the byte at the given position of the payload, from the
+	 * payload array or the segments
+	 */
+	uint8_t getPayloadByte(uint8_t pos);
 private:
 	uint8_t* _payloadPtr;
 	uint8_t _payloadLength;
+	const PayloadSegment *_segments;
+	uint8_t _segmentCount;
+	// segment containing the last byte returned and the payload position
+	// it starts at, since the payload is normally read in order
+	uint8_t _segment;
+	uint8_t _segmentStart;
 };
 
 #ifdef SERIES_1
@@ -1267,6 +1756,45 @@ private:
 	uint16_t _clusterId;
 };
 
+/**
+ * A ZB TX destination (addresses, broadcast radius and options) that is
+ * encoded once, for sending many frames to the same node with
+ * XBee::send(ZBTxDestination&, ...). The escaped header bytes and their
+ * checksum are kept, so each send only has to encode the frame id and
+ * the payload.
+ *
+ * Example:
+ *
+ * ZBTxDestination coordinator(XBeeAddress64(0, 0));
+ *
+ * void loop() {
+ *   uint8_t payload[] = { analogRead(0) >> 2 };
+ *   xbee.send(coordinator, payload, sizeof(payload), xbee.getNextFrameId());
+ * }
+ */
+class ZBTxDestination {
+public:
+	ZBTxDestination(const XBeeAddress64 &addr64, uint16_t addr16 = ZB_BROADCAST_ADDRESS, uint8_t broadcastRadius = ZB_BROADCAST_RADIUS_MAX_HOPS, uint8_t option = ZB_TX_UNICAST);
+	/**
+	 * Changes the destination. This re-encodes the header, so only
+	 * call it when the destination actually changes
+	 */
+	void set(const XBeeAddress64 &addr64, uint16_t addr16 = ZB_BROADCAST_ADDRESS, uint8_t broadcastRadius = ZB_BROADCAST_RADIUS_MAX_HOPS, uint8_t option = ZB_TX_UNICAST);
+	XBeeAddress64 getAddress64();
+	uint16_t getAddress16();
+	uint8_t getBroadcastRadius();
+	uint8_t getOption();
+private:
+	friend class XBee;
+	// the header as it appears in the frame data, after the frame id
+	uint8_t _raw[ZB_TX_API_LENGTH];
+	// the same, escaped
+	uint8_t _escaped[ZB_TX_API_LENGTH * 2];
+	uint8_t _escapedLength;
+	// sum of the api id and the header bytes
+	uint8_t _checksum;
+};
+
 #endif
 
 /**
@@ -1341,5 +1869,88 @@ private:
 };
 
 
+// Start byte, length, api id and frame id in front of the header
+#define XBEE_TX_BUFFER_FRAME_HEADER 5
+// Size of an XBeeTxBuffer buffer that fits any TX request with the given
+// payload length
+#define XBEE_TX_BUFFER_SIZE(payloadLength) (XBEE_TX_BUFFER_FRAME_HEADER + ZB_EXPLICIT_TX_API_LENGTH + (payloadLength))
+
+/**
+ * Builds a TX request directly in a buffer supplied by the caller, so the
+ * payload does not need an array of its own. One of the begin methods
+ * writes the frame header at the start of the buffer and returns where
+ * the payload goes, the application writes its payload there and
+ * XBee::send(XBeeTxBuffer&, length) completes and sends the frame.
+ *
+ * The buffer can be reused for the next frame once sent. This is also
+ * an XBeeRequest, so it can be passed to XBee::send(XBeeRequest&) or
+ * sendAndWait() after setPayloadLength().
+ *
+ * Example:
+ *
+ * uint8_t txBuf[XBEE_TX_BUFFER_SIZE(16)];
+ * XBeeTxBuffer tx(txBuf, sizeof(txBuf));
+ *
+ * void loop() {
+ *   uint8_t *p = tx.beginZBTx(XBeeAddress64(0, 0));
+ *   p[0] = analogRead(0) >> 2;
+ *   p[1] = analogRead(1) >> 2;
+ *   xbee.send(tx, 2);
+ * }
+ */
+class XBeeTxBuffer : public XBeeRequest {
+public:
+	XBeeTxBuffer(uint8_t *buffer, uint8_t size);
+#ifdef SERIES_2
+	/**
+	 * Starts a ZB_TX_REQUEST, returns the payload or NULL if the
+	 * buffer is too small for the header
+	 */
+	uint8_t* beginZBTx(const XBeeAddress64 &addr64, uint16_t addr16 = ZB_BROADCAST_ADDRESS, uint8_t broadcastRadius = ZB_BROADCAST_RADIUS_MAX_HOPS, uint8_t option = ZB_TX_UNICAST, uint8_t frameId = DEFAULT_FRAME_ID);
+	/**
+	 * Starts a ZB_EXPLICIT_TX_REQUEST, returns the payload or NULL if
+	 * the buffer is too small for the header
+	 */
+	uint8_t* beginZBExplicitTx(const XBeeAddress64 &addr64, uint16_t addr16, uint8_t broadcastRadius, uint8_t option, uint8_t srcEndpoint, uint8_t dstEndpoint, uint16_t clusterId, uint16_t profileId, uint8_t frameId = DEFAULT_FRAME_ID);
+#endif
+#ifdef SERIES_1
+	/**
+	 * Starts a TX_16_REQUEST, returns the payload or NULL if the buffer
+	 * is too small for the header
+	 */
+	uint8_t* beginTx16(uint16_t addr16, uint8_t option = ACK_OPTION, uint8_t frameId = DEFAULT_FRAME_ID);
+	/**
+	 * Starts a TX_64_REQUEST, returns the payload or NULL if the buffer
+	 * is too small for the header
+	 */
+	uint8_t* beginTx64(const XBeeAddress64 &addr64, uint8_t option = ACK_OPTION, uint8_t frameId = DEFAULT_FRAME_ID);
+#endif
+	/**
+	 * Returns where the payload of the current frame goes
+	 */
+	uint8_t* getPayload() { return _buffer + _headerLength; }
+	/**
+	 * Returns the number of payload bytes that fit in the buffer
+	 */
+	uint8_t getMaxPayloadLength() { return _size - _headerLength; }
+	uint8_t getPayloadLength() { return _payloadLength; }
+	/**
+	 * Sets the number of payload bytes to send, limited to
+	 * getMaxPayloadLength()
+	 */
+	void setPayloadLength(uint8_t payloadLength);
+	uint8_t getFrameData(uint8_t pos);
+	uint8_t getFrameDataLength();
+private:
+	friend class XBee;
+
+	uint8_t* begin(uint8_t apiId, uint8_t frameId, uint8_t headerLength);
+
+	uint8_t *_buffer;
+	uint8_t _size;
+	// frame header plus api specific header
+	uint8_t _headerLength;
+	uint8_t _payloadLength;
+};
 
 #endif //XBee_h
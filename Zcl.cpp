@@ -0,0 +1,302 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Zcl.h"
+
+uint8_t zclGetTypeSize(uint8_t type) {
+	if (type >= 0x08 && type <= 0x0f) {
+		// data8 to data64
+		return type - 0x07;
+	} else if (type >= 0x18 && type <= 0x2f) {
+		// bitmap, uint and int, 8 to 64 bits
+		return (type & 0x07) + 1;
+	}
+
+	switch (type) {
+		case ZCL_NO_DATA:
+		case ZCL_UNKNOWN:
+			return 0;
+		case ZCL_BOOL:
+		case ZCL_ENUM8:
+			return 1;
+		case ZCL_ENUM16:
+		case ZCL_SEMI_FLOAT:
+		case ZCL_CLUSTER_ID:
+		case ZCL_ATTRIBUTE_ID:
+			return 2;
+		case ZCL_FLOAT:
+		case ZCL_TIME_OF_DAY:
+		case ZCL_DATE:
+		case ZCL_UTC_TIME:
+		case ZCL_BACNET_OID:
+			return 4;
+		case ZCL_DOUBLE:
+		case ZCL_IEEE_ADDRESS:
+			return 8;
+		case ZCL_SECURITY_KEY:
+			return 16;
+		case ZCL_OCTET_STRING:
+		case ZCL_CHAR_STRING:
+		case ZCL_LONG_OCTET_STRING:
+		case ZCL_LONG_CHAR_STRING:
+			return ZCL_SIZE_STRING;
+		default:
+			return ZCL_SIZE_UNSUPPORTED;
+	}
+}
+
+bool zclIsAnalog(uint8_t type) {
+	// uint, int, floats and times
+	return (type >= 0x20 && type <= 0x2f) || (type >= 0x38 && type <= 0x3a) || (type >= 0xe0 && type <= 0xe2);
+}
+
+uint8_t ZclReader::read8() {
+	if (_pos >= _length) {
+		_error = true;
+		return 0;
+	}
+
+	return _data[_pos++];
+}
+
+uint16_t ZclReader::read16() {
+	const uint8_t *p = readBytes(2);
+	return p ? p[0] | ((uint16_t)p[1] << 8) : 0;
+}
+
+uint32_t ZclReader::read32() {
+	const uint8_t *p = readBytes(4);
+	return p ? p[0] | ((uint16_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24) : 0;
+}
+
+const uint8_t* ZclReader::readBytes(uint8_t length) {
+	if (length > _length - _pos) {
+		_error = true;
+		_pos = _length;
+		return NULL;
+	}
+
+	const uint8_t *p = _data + _pos;
+	_pos += length;
+
+	return p;
+}
+
+void ZclWriter::begin(uint8_t frameControl, uint8_t transactionSequence, uint8_t commandId, uint16_t manufacturerCode) {
+	_length = 0;
+	_overflow = false;
+
+	write8(frameControl);
+
+	if (frameControl & ZCL_MANUFACTURER_SPECIFIC) {
+		write16(manufacturerCode);
+	}
+
+	write8(transactionSequence);
+	write8(commandId);
+}
+
+void ZclWriter::write8(uint8_t value) {
+	if (_length < _size) {
+		_buffer[_length++] = value;
+	} else {
+		_overflow = true;
+	}
+}
+
+void ZclWriter::write16(uint16_t value) {
+	writeUint(value, 2);
+}
+
+void ZclWriter::write32(uint32_t value) {
+	writeUint(value, 4);
+}
+
+void ZclWriter::writeUint(uint32_t value, uint8_t length) {
+	for (uint8_t i = 0; i < length; i++) {
+		write8(i < 4 ? value >> (i * 8) : 0);
+	}
+}
+
+void ZclWriter::writeBytes(const uint8_t *data, uint8_t length) {
+	if (length > _size - _length) {
+		_overflow = true;
+		return;
+	}
+
+	memcpy(_buffer + _length, data, length);
+	_length += length;
+}
+
+void ZclWriter::addAttribute(uint16_t id, uint8_t type, uint32_t value) {
+	uint8_t size = zclGetTypeSize(type);
+
+	if (size >= ZCL_SIZE_STRING) {
+		// strings need the other version, the rest is not supported
+		_overflow = true;
+		return;
+	}
+
+	write16(id);
+	write8(type);
+	writeUint(value, size);
+}
+
+void ZclWriter::addAttribute(uint16_t id, uint8_t type, const uint8_t *data, uint8_t length) {
+	write16(id);
+	write8(type);
+
+	if (type == ZCL_LONG_OCTET_STRING || type == ZCL_LONG_CHAR_STRING) {
+		write16(length);
+	} else {
+		write8(length);
+	}
+
+	writeBytes(data, length);
+}
+
+void ZclWriter::addReportingConfiguration(uint16_t id, uint8_t type, uint16_t minInterval, uint16_t maxInterval, uint32_t reportableChange) {
+	// direction: reported by the server
+	write8(0);
+	write16(id);
+	write8(type);
+	write16(minInterval);
+	write16(maxInterval);
+
+	if (zclIsAnalog(type)) {
+		writeUint(reportableChange, zclGetTypeSize(type));
+	}
+}
+
+bool ZclFrame::parse(const uint8_t *data, uint8_t length) {
+	ZclReader reader(data, length);
+
+	_frameControl = reader.read8();
+	_manufacturerCode = (_frameControl & ZCL_MANUFACTURER_SPECIFIC) ? reader.read16() : 0;
+	_transactionSequence = reader.read8();
+	_commandId = reader.read8();
+
+	if (reader.isError()) {
+		_payload = ZclReader();
+		return false;
+	}
+
+	_payload = ZclReader(data + reader.getPosition(), reader.getRemaining());
+
+	return true;
+}
+
+uint32_t ZclAttribute::getUint() {
+	uint32_t value = 0;
+
+	for (uint8_t i = _length < 4 ? _length : 4; i > 0; i--) {
+		value = (value << 8) | _value[i - 1];
+	}
+
+	return value;
+}
+
+int32_t ZclAttribute::getInt() {
+	uint32_t value = getUint();
+
+	// sign extend values shorter than 32 bits
+	if (_length > 0 && _length < 4 && (_value[_length - 1] & 0x80)) {
+		value |= 0xffffffffUL << (_length * 8);
+	}
+
+	return (int32_t)value;
+}
+
+float ZclAttribute::getFloat() {
+	float value = 0;
+
+	if (_length == sizeof(float)) {
+		// little-endian IEEE 754, like the supported MCUs
+		memcpy(&value, _value, sizeof(float));
+	}
+
+	return value;
+}
+
+ZclAttributeReader::ZclAttributeReader(ZclFrame &frame) {
+	_hasStatus = false;
+	_error = false;
+
+	if (frame.isClusterSpecific()) {
+		return;
+	}
+
+	switch (frame.getCommandId()) {
+		case ZCL_READ_ATTRIBUTES_RESPONSE:
+			_hasStatus = true;
+			_reader = frame.getPayload();
+			break;
+		case ZCL_WRITE_ATTRIBUTES:
+		case ZCL_WRITE_ATTRIBUTES_UNDIVIDED:
+		case ZCL_WRITE_ATTRIBUTES_NO_RESPONSE:
+		case ZCL_REPORT_ATTRIBUTES:
+			_reader = frame.getPayload();
+			break;
+	}
+}
+
+bool ZclAttributeReader::next(ZclAttribute &attribute) {
+	if (_error || _reader.getRemaining() == 0) {
+		return false;
+	}
+
+	attribute._id = _reader.read16();
+	attribute._status = _hasStatus ? _reader.read8() : ZCL_SUCCESS;
+	attribute._type = ZCL_NO_DATA;
+	attribute._value = NULL;
+	attribute._length = 0;
+
+	if (attribute._status == ZCL_SUCCESS) {
+		attribute._type = _reader.read8();
+		uint8_t size = zclGetTypeSize(attribute._type);
+
+		if (size == ZCL_SIZE_STRING) {
+			bool isLong = attribute._type == ZCL_LONG_OCTET_STRING || attribute._type == ZCL_LONG_CHAR_STRING;
+			uint16_t length = isLong ? _reader.read16() : _reader.read8();
+
+			// all ones means an invalid (empty) string
+			if (length == (isLong ? 0xffff : 0xff)) {
+				length = 0;
+			}
+
+			size = length <= 0xff ? length : ZCL_SIZE_UNSUPPORTED;
+		}
+
+		if (size == ZCL_SIZE_UNSUPPORTED) {
+			_error = true;
+			return false;
+		}
+
+		attribute._value = _reader.readBytes(size);
+		attribute._length = size;
+	}
+
+	if (_reader.isError()) {
+		_error = true;
+		return false;
+	}
+
+	return true;
+}
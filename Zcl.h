@@ -0,0 +1,327 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XBee_Zcl_h
+#define XBee_Zcl_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+
+#define ZCL_HA_PROFILE_ID 0x0104
+
+// Frame control bits
+#define ZCL_FRAME_TYPE_MASK 0x03
+#define ZCL_FRAME_TYPE_GLOBAL 0x00
+#define ZCL_FRAME_TYPE_CLUSTER 0x01
+#define ZCL_MANUFACTURER_SPECIFIC 0x04
+#define ZCL_SERVER_TO_CLIENT 0x08
+#define ZCL_DISABLE_DEFAULT_RESPONSE 0x10
+
+// Global commands
+#define ZCL_READ_ATTRIBUTES 0x00
+#define ZCL_READ_ATTRIBUTES_RESPONSE 0x01
+#define ZCL_WRITE_ATTRIBUTES 0x02
+#define ZCL_WRITE_ATTRIBUTES_UNDIVIDED 0x03
+#define ZCL_WRITE_ATTRIBUTES_RESPONSE 0x04
+#define ZCL_WRITE_ATTRIBUTES_NO_RESPONSE 0x05
+#define ZCL_CONFIGURE_REPORTING 0x06
+#define ZCL_CONFIGURE_REPORTING_RESPONSE 0x07
+#define ZCL_READ_REPORTING_CONFIGURATION 0x08
+#define ZCL_READ_REPORTING_CONFIGURATION_RESPONSE 0x09
+#define ZCL_REPORT_ATTRIBUTES 0x0a
+#define ZCL_DEFAULT_RESPONSE 0x0b
+
+// Status codes
+#define ZCL_SUCCESS 0x00
+#define ZCL_FAILURE 0x01
+#define ZCL_MALFORMED_COMMAND 0x80
+#define ZCL_UNSUP_CLUSTER_COMMAND 0x81
+#define ZCL_UNSUP_GENERAL_COMMAND 0x82
+#define ZCL_INVALID_FIELD 0x85
+#define ZCL_UNSUPPORTED_ATTRIBUTE 0x86
+#define ZCL_INVALID_VALUE 0x87
+#define ZCL_READ_ONLY 0x88
+#define ZCL_INSUFFICIENT_SPACE 0x89
+#define ZCL_INVALID_DATA_TYPE 0x8d
+#define ZCL_UNREPORTABLE_ATTRIBUTE 0x8c
+#define ZCL_NO_IMAGE_AVAILABLE 0x98
+
+// Data types. The 8 to 64 bit variants of data, bitmap, uint and int
+// follow each other, e.g. ZCL_UINT8 + 1 is a 16-bit uint.
+#define ZCL_NO_DATA 0x00
+#define ZCL_DATA8 0x08
+#define ZCL_BOOL 0x10
+#define ZCL_BITMAP8 0x18
+#define ZCL_UINT8 0x20
+#define ZCL_UINT16 0x21
+#define ZCL_UINT24 0x22
+#define ZCL_UINT32 0x23
+#define ZCL_INT8 0x28
+#define ZCL_INT16 0x29
+#define ZCL_INT24 0x2a
+#define ZCL_INT32 0x2b
+#define ZCL_ENUM8 0x30
+#define ZCL_ENUM16 0x31
+#define ZCL_SEMI_FLOAT 0x38
+#define ZCL_FLOAT 0x39
+#define ZCL_DOUBLE 0x3a
+#define ZCL_OCTET_STRING 0x41
+#define ZCL_CHAR_STRING 0x42
+#define ZCL_LONG_OCTET_STRING 0x43
+#define ZCL_LONG_CHAR_STRING 0x44
+#define ZCL_TIME_OF_DAY 0xe0
+#define ZCL_DATE 0xe1
+#define ZCL_UTC_TIME 0xe2
+#define ZCL_CLUSTER_ID 0xe8
+#define ZCL_ATTRIBUTE_ID 0xe9
+#define ZCL_BACNET_OID 0xea
+#define ZCL_IEEE_ADDRESS 0xf0
+#define ZCL_SECURITY_KEY 0xf1
+#define ZCL_UNKNOWN 0xff
+
+// Returned by zclGetTypeSize()
+#define ZCL_SIZE_STRING 0xfe
+#define ZCL_SIZE_UNSUPPORTED 0xff
+
+/**
+ * Returns the size of values of the given data type,
+ * ZCL_SIZE_STRING for (long) strings, which start with their length,
+ * or ZCL_SIZE_UNSUPPORTED for arrays, structures, sets, bags and
+ * reserved types.
+ */
+uint8_t zclGetTypeSize(uint8_t type);
+
+/**
+ * Returns true for analog data types (integers, floats and times), the
+ * types for which Configure Reporting includes a reportable change.
+ */
+bool zclIsAnalog(uint8_t type);
+
+/**
+ * Reads little-endian fields from a buffer without copying it. Reading
+ * past the end returns zeros and sets the error flag.
+ */
+class ZclReader {
+public:
+	ZclReader() : _data(NULL), _length(0), _pos(0), _error(false) {}
+	ZclReader(const uint8_t *data, uint8_t length) : _data(data), _length(length), _pos(0), _error(false) {}
+
+	uint8_t read8();
+	uint16_t read16();
+	uint32_t read32();
+	/**
+	 * Skips length bytes and returns a pointer to them, or NULL
+	 */
+	const uint8_t* readBytes(uint8_t length);
+
+	uint8_t getRemaining() { return _length - _pos; }
+	uint8_t getPosition() { return _pos; }
+	bool isError() { return _error; }
+protected:
+	const uint8_t *_data;
+	uint8_t _length;
+	uint8_t _pos;
+	bool _error;
+};
+
+/**
+ * Writes little-endian fields into a buffer, typically the payload of
+ * an XBeeTxBuffer, so commands are encoded directly into the TX frame.
+ * When the buffer is full, further writes are dropped and isOverflow()
+ * returns true.
+ */
+class ZclWriter {
+public:
+	ZclWriter(uint8_t *buffer, uint8_t size) : _buffer(buffer), _size(buffer ? size : 0), _length(0), _overflow(false) {}
+
+	/**
+	 * Writes the ZCL header. A manufacturer code is written when
+	 * frameControl has ZCL_MANUFACTURER_SPECIFIC.
+	 */
+	void begin(uint8_t frameControl, uint8_t transactionSequence, uint8_t commandId, uint16_t manufacturerCode = 0);
+
+	void write8(uint8_t value);
+	void write16(uint16_t value);
+	void write32(uint32_t value);
+	/**
+	 * Writes the lowest length bytes of value
+	 */
+	void writeUint(uint32_t value, uint8_t length);
+	void writeBytes(const uint8_t *data, uint8_t length);
+
+	/**
+	 * Adds an attribute id, for Read Attributes
+	 */
+	void addAttributeId(uint16_t id) { write16(id); }
+	/**
+	 * Adds an attribute record with a value of a fixed size type (up to
+	 * 32 bits), for Write Attributes and Report Attributes
+	 */
+	void addAttribute(uint16_t id, uint8_t type, uint32_t value);
+	/**
+	 * Adds an attribute record with a (char or octet) string value
+	 */
+	void addAttribute(uint16_t id, uint8_t type, const uint8_t *data, uint8_t length);
+	/**
+	 * Adds an attribute reporting configuration record (direction 0,
+	 * reports sent by the server), for Configure Reporting. The
+	 * reportable change is only written for analog types.
+	 */
+	void addReportingConfiguration(uint16_t id, uint8_t type, uint16_t minInterval, uint16_t maxInterval, uint32_t reportableChange = 0);
+
+	uint8_t* getBuffer() { return _buffer; }
+	/**
+	 * Number of bytes written, the payload length to send
+	 */
+	uint8_t getLength() { return _length; }
+	bool isOverflow() { return _overflow; }
+private:
+	uint8_t *_buffer;
+	uint8_t _size;
+	uint8_t _length;
+	bool _overflow;
+};
+
+/**
+ * The header of a ZCL frame and a reader positioned on its payload,
+ * pointing into the received data.
+ *
+ * Example:
+ *
+ * void zbExplicitRx(ZBExplicitRxResponse &rx, uintptr_t) {
+ *   ZclFrame zcl;
+ *   if (!zcl.parse(rx) || zcl.isClusterSpecific())
+ *     return;
+ *   if (zcl.getCommandId() == ZCL_REPORT_ATTRIBUTES) {
+ *     ZclAttributeReader reader(zcl);
+ *     ZclAttribute attr;
+ *     while (reader.next(attr))
+ *       if (rx.getClusterId() == 0x0402 && attr.getId() == 0)
+ *         temperature = attr.getInt();
+ *   }
+ * }
+ */
+class ZclFrame {
+public:
+	ZclFrame() : _frameControl(0), _manufacturerCode(0), _transactionSequence(0), _commandId(0) {}
+
+	/**
+	 * Parses the header, returns false if the data is too short
+	 */
+	bool parse(const uint8_t *data, uint8_t length);
+#ifdef SERIES_2
+	bool parse(ZBExplicitRxResponse &rx) { return parse(rx.getData(), rx.getDataLength()); }
+#endif
+
+	uint8_t getFrameControl() { return _frameControl; }
+	bool isClusterSpecific() { return (_frameControl & ZCL_FRAME_TYPE_MASK) == ZCL_FRAME_TYPE_CLUSTER; }
+	bool isManufacturerSpecific() { return _frameControl & ZCL_MANUFACTURER_SPECIFIC; }
+	bool isServerToClient() { return _frameControl & ZCL_SERVER_TO_CLIENT; }
+	bool isDefaultResponseDisabled() { return _frameControl & ZCL_DISABLE_DEFAULT_RESPONSE; }
+	uint16_t getManufacturerCode() { return _manufacturerCode; }
+	uint8_t getTransactionSequence() { return _transactionSequence; }
+	uint8_t getCommandId() { return _commandId; }
+	/**
+	 * Returns a reader for the payload, after the header
+	 */
+	ZclReader getPayload() { return _payload; }
+private:
+	uint8_t _frameControl;
+	uint16_t _manufacturerCode;
+	uint8_t _transactionSequence;
+	uint8_t _commandId;
+	ZclReader _payload;
+};
+
+/**
+ * One attribute record, pointing into the received data
+ */
+class ZclAttribute {
+public:
+	ZclAttribute() : _id(0), _status(ZCL_SUCCESS), _type(ZCL_NO_DATA), _value(NULL), _length(0) {}
+
+	uint16_t getId() { return _id; }
+	/**
+	 * The status of a Read Attributes Response record, ZCL_SUCCESS for
+	 * other records. There is no type or value unless successful.
+	 */
+	uint8_t getStatus() { return _status; }
+	uint8_t getType() { return _type; }
+	/**
+	 * The raw value, little-endian. For strings, the characters
+	 * without the length.
+	 */
+	const uint8_t* getValue() { return _value; }
+	uint8_t getValueLength() { return _length; }
+
+	/**
+	 * The value of an unsigned integer, bitmap, enum, data or bool
+	 * type, the lowest 32 bits of longer values
+	 */
+	uint32_t getUint();
+	/**
+	 * The value of a signed integer type, sign extended
+	 */
+	int32_t getInt();
+	bool getBool() { return getUint() != 0; }
+	/**
+	 * The value of a ZCL_FLOAT
+	 */
+	float getFloat();
+private:
+	friend class ZclAttributeReader;
+
+	uint16_t _id;
+	uint8_t _status;
+	uint8_t _type;
+	const uint8_t *_value;
+	uint8_t _length;
+};
+
+/**
+ * Iterates over the attribute records of a Report Attributes, Read
+ * Attributes Response or Write Attributes frame, in place. Iteration
+ * stops at the end of the frame, or at a record that is truncated or
+ * has a data type that is not supported, in which case isError()
+ * returns true.
+ */
+class ZclAttributeReader {
+public:
+	ZclAttributeReader(ZclFrame &frame);
+
+	/**
+	 * Fills attribute with the next record, returns false when there
+	 * are no more
+	 */
+	bool next(ZclAttribute &attribute);
+
+	bool isError() { return _error; }
+private:
+	ZclReader _reader;
+	bool _hasStatus;
+	bool _error;
+};
+
+#endif // XBee_Zcl_h
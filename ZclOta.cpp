@@ -0,0 +1,395 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ZclOta.h"
+
+#ifdef SERIES_2
+
+#ifndef ARDUINO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static bool sameAddress(XBeeAddress64 &a, XBeeAddress64 &b) {
+	return a.getMsb() == b.getMsb() && a.getLsb() == b.getLsb();
+}
+
+bool OtaMemorySource::read(uint32_t offset, uint8_t *buffer, uint8_t length) {
+	if (offset > _size || length > _size - offset) {
+		return false;
+	}
+
+	memcpy(buffer, _data + offset, length);
+	return true;
+}
+
+#ifndef ARDUINO
+OtaFileSource::OtaFileSource(const char *path) : OtaMemorySource(NULL, 0) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0) {
+		return;
+	}
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size <= 0xffffffffUL) {
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data != MAP_FAILED) {
+			_data = (const uint8_t*)data;
+			_size = st.st_size;
+		}
+	}
+
+	// the mapping stays valid after closing
+	close(fd);
+}
+
+OtaFileSource::~OtaFileSource() {
+	if (_data != NULL) {
+		munmap((void*)_data, _size);
+	}
+}
+#endif
+
+OtaServer::OtaServer(XBee &xbee, OtaClient *clients, uint8_t size, uint8_t localEndpoint, uint16_t profileId) {
+	_xbee = &xbee;
+	_clients = clients;
+	_size = size;
+	_count = 0;
+	_next = 0;
+	_localEndpoint = localEndpoint;
+	_profileId = profileId;
+	_imageCount = 0;
+	_maxPayload = OTA_SERVER_MAX_PAYLOAD;
+	_npFrameId = 0;
+	_minInterval = OTA_SERVER_MIN_INTERVAL;
+	_lastSend = 0;
+	_onUpgradeEnd = NULL;
+	_onUpgradeEndData = 0;
+}
+
+bool OtaServer::addImage(OtaImageSource &source) {
+	uint8_t header[ZCL_OTA_HEADER_SIZE];
+
+	if (_imageCount == OTA_SERVER_IMAGES || !source.read(0, header, sizeof(header))) {
+		return false;
+	}
+
+	// file identifier, header version, header length, header field
+	// control, manufacturer code, image type, file version, stack
+	// version, header string (32 bytes), total image size
+	ZclReader reader(header, sizeof(header));
+	uint32_t identifier = reader.read32();
+	reader.readBytes(6);
+
+	Image *image = &_images[_imageCount];
+	image->source = &source;
+	image->manufacturerCode = reader.read16();
+	image->imageType = reader.read16();
+	image->fileVersion = reader.read32();
+	reader.readBytes(34);
+	image->size = reader.read32();
+
+	if (identifier != ZCL_OTA_FILE_IDENTIFIER || image->size > source.getSize()) {
+		return false;
+	}
+
+	_imageCount++;
+	return true;
+}
+
+void OtaServer::requestMaxPayloadSize() {
+	static uint8_t np[] = { 'N', 'P' };
+	AtCommandRequest request(np);
+
+	_npFrameId = _xbee->getNextFrameId();
+	request.setFrameId(_npFrameId);
+	_xbee->send(request);
+}
+
+void OtaServer::setMaxPayloadSize(uint8_t size) {
+	_maxPayload = size < OTA_SERVER_MAX_PAYLOAD ? size : OTA_SERVER_MAX_PAYLOAD;
+}
+
+void OtaServer::notify(XBeeAddress64 &address, uint8_t endpoint) {
+	uint8_t buffer[XBEE_TX_BUFFER_SIZE(5)];
+	XBeeTxBuffer tx(buffer, sizeof(buffer));
+	uint8_t *payload = tx.beginZBExplicitTx(address, ZB_BROADCAST_ADDRESS, 0, 0, _localEndpoint, endpoint, ZCL_OTA_CLUSTER_ID, _profileId, 0);
+	ZclWriter writer(payload, tx.getMaxPayloadLength());
+
+	// payload type 0: query jitter only
+	writer.begin(ZCL_FRAME_TYPE_CLUSTER | ZCL_SERVER_TO_CLIENT | ZCL_DISABLE_DEFAULT_RESPONSE, 0, ZCL_OTA_IMAGE_NOTIFY);
+	writer.write8(0);
+	writer.write8(OTA_SERVER_NOTIFY_JITTER);
+
+	_xbee->send(tx, writer.getLength());
+}
+
+OtaServer::Image* OtaServer::findImage(uint16_t manufacturerCode, uint16_t imageType) {
+	for (uint8_t i = 0; i < _imageCount; i++) {
+		if (_images[i].manufacturerCode == manufacturerCode && _images[i].imageType == imageType) {
+			return &_images[i];
+		}
+	}
+
+	return NULL;
+}
+
+OtaClient* OtaServer::getClient(XBeeAddress64 &address) {
+	OtaClient *oldest = NULL;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		OtaClient *client = &_clients[i];
+
+		if (sameAddress(client->address, address)) {
+			return client;
+		}
+
+		if (client->request == OTA_CLIENT_IDLE && (oldest == NULL || (int32_t)(client->time - oldest->time) < 0)) {
+			oldest = client;
+		}
+	}
+
+	if (_count < _size) {
+		oldest = &_clients[_count++];
+	}
+
+	if (oldest != NULL) {
+		oldest->address = address;
+		oldest->request = OTA_CLIENT_IDLE;
+		oldest->status = ZCL_SUCCESS;
+		oldest->bytesSent = 0;
+	}
+
+	return oldest;
+}
+
+void OtaServer::onResponse(XBeeResponse &response) {
+	uint8_t id = response.getApiId();
+
+	if (id == ZB_EXPLICIT_RX_RESPONSE) {
+		ZBExplicitRxResponse rx;
+		response.getZBExplicitRxResponse(rx);
+
+		if (rx.getProfileId() == _profileId && rx.getClusterId() == ZCL_OTA_CLUSTER_ID) {
+			handleRequest(rx);
+		}
+	} else if (id == AT_COMMAND_RESPONSE && _npFrameId != 0) {
+		AtCommandResponse at;
+		response.getAtCommandResponse(at);
+
+		if (at.getFrameId() == _npFrameId) {
+			_npFrameId = 0;
+
+			if (at.isOk() && at.getValueLength() == 2) {
+				uint16_t np = ((uint16_t)at.getValue()[0] << 8) | at.getValue()[1];
+				setMaxPayloadSize(np < 0xff ? np : 0xff);
+			}
+		}
+	}
+}
+
+void OtaServer::handleRequest(ZBExplicitRxResponse &rx) {
+	ZclFrame frame;
+
+	if (!frame.parse(rx) || !frame.isClusterSpecific() || frame.isServerToClient()) {
+		return;
+	}
+
+	uint8_t command = frame.getCommandId();
+
+	if (command != ZCL_OTA_QUERY_NEXT_IMAGE_REQUEST && command != ZCL_OTA_IMAGE_BLOCK_REQUEST && command != ZCL_OTA_UPGRADE_END_REQUEST) {
+		return;
+	}
+
+	// Query Next Image and Image Block Requests start with a field
+	// control byte, the Upgrade End Request with a status. The optional
+	// fields at the end are not used.
+	ZclReader reader = frame.getPayload();
+	uint8_t first = reader.read8();
+	uint16_t manufacturerCode = reader.read16();
+	uint16_t imageType = reader.read16();
+	uint32_t fileVersion = reader.read32();
+	uint32_t offset = 0;
+	uint8_t maxDataSize = 0;
+
+	if (command == ZCL_OTA_IMAGE_BLOCK_REQUEST) {
+		offset = reader.read32();
+		maxDataSize = reader.read8();
+	}
+
+	if (reader.isError()) {
+		return;
+	}
+
+	OtaClient *client = getClient(rx.getRemoteAddress64());
+
+	if (client == NULL) {
+		// table full, the client will retry
+		return;
+	}
+
+	// a newer request replaces one that was not answered yet
+	client->endpoint = rx.getSrcEndpoint();
+	client->request = command;
+	client->transactionSequence = frame.getTransactionSequence();
+	client->manufacturerCode = manufacturerCode;
+	client->imageType = imageType;
+	client->fileVersion = fileVersion;
+	client->offset = offset;
+	client->maxDataSize = maxDataSize;
+	client->time = millis();
+
+	if (command == ZCL_OTA_UPGRADE_END_REQUEST) {
+		client->status = first;
+	}
+}
+
+void OtaServer::writeQueryResponse(OtaClient &client, ZclWriter &writer) {
+	Image *image = findImage(client.manufacturerCode, client.imageType);
+
+	// an image with a different version is offered, which also allows
+	// rolling nodes back
+	if (image == NULL || image->fileVersion == client.fileVersion) {
+		writer.write8(ZCL_NO_IMAGE_AVAILABLE);
+		return;
+	}
+
+	writer.write8(ZCL_SUCCESS);
+	writer.write16(image->manufacturerCode);
+	writer.write16(image->imageType);
+	writer.write32(image->fileVersion);
+	writer.write32(image->size);
+}
+
+uint8_t OtaServer::writeBlockResponse(OtaClient &client, ZclWriter &writer, uint8_t size) {
+	Image *image = findImage(client.manufacturerCode, client.imageType);
+
+	if (image == NULL || image->fileVersion != client.fileVersion) {
+		writer.write8(ZCL_NO_IMAGE_AVAILABLE);
+		return writer.getLength();
+	}
+
+	if (client.offset >= image->size || size <= OTA_SERVER_BLOCK_OVERHEAD) {
+		writer.write8(ZCL_OTA_ABORT);
+		return writer.getLength();
+	}
+
+	uint8_t length = size - OTA_SERVER_BLOCK_OVERHEAD;
+
+	if (client.maxDataSize < length) {
+		length = client.maxDataSize;
+	}
+
+	if (image->size - client.offset < length) {
+		length = image->size - client.offset;
+	}
+
+	uint8_t status = writer.getLength();
+
+	writer.write8(ZCL_SUCCESS);
+	writer.write16(image->manufacturerCode);
+	writer.write16(image->imageType);
+	writer.write32(image->fileVersion);
+	writer.write32(client.offset);
+	writer.write8(length);
+
+	// read straight into the frame
+	if (!image->source->read(client.offset, writer.getBuffer() + writer.getLength(), length)) {
+		writer.getBuffer()[status] = ZCL_OTA_ABORT;
+		return status + 1;
+	}
+
+	client.bytesSent += length;
+	return writer.getLength() + length;
+}
+
+bool OtaServer::loop() {
+	uint32_t now = millis();
+
+	if (_count == 0 || now - _lastSend < _minInterval) {
+		return false;
+	}
+
+	// take turns, starting after the last client served
+	OtaClient *client = NULL;
+
+	for (uint8_t i = 0; i < _count && client == NULL; i++) {
+		uint8_t index = (_next + i) % _count;
+
+		if (_clients[index].request != OTA_CLIENT_IDLE) {
+			client = &_clients[index];
+			_next = index + 1;
+		}
+	}
+
+	if (client == NULL) {
+		return false;
+	}
+
+	uint8_t command = client->request;
+	client->request = OTA_CLIENT_IDLE;
+
+	if (command == ZCL_OTA_UPGRADE_END_REQUEST) {
+		if (_onUpgradeEnd) {
+			_onUpgradeEnd(*client, _onUpgradeEndData);
+		}
+
+		if (client->status != ZCL_SUCCESS) {
+			// the client gave up, nothing to answer
+			return false;
+		}
+	}
+
+	uint8_t buffer[XBEE_TX_BUFFER_SIZE(OTA_SERVER_MAX_PAYLOAD)];
+	XBeeTxBuffer tx(buffer, sizeof(buffer));
+	uint8_t *payload = tx.beginZBExplicitTx(client->address, ZB_BROADCAST_ADDRESS, 0, 0, _localEndpoint, client->endpoint, ZCL_OTA_CLUSTER_ID, _profileId, _xbee->getNextFrameId());
+	uint8_t size = _maxPayload < tx.getMaxPayloadLength() ? _maxPayload : tx.getMaxPayloadLength();
+	ZclWriter writer(payload, size);
+	uint8_t length;
+
+	if (command == ZCL_OTA_QUERY_NEXT_IMAGE_REQUEST) {
+		writer.begin(ZCL_FRAME_TYPE_CLUSTER | ZCL_SERVER_TO_CLIENT | ZCL_DISABLE_DEFAULT_RESPONSE, client->transactionSequence, ZCL_OTA_QUERY_NEXT_IMAGE_RESPONSE);
+		writeQueryResponse(*client, writer);
+		length = writer.getLength();
+	} else if (command == ZCL_OTA_IMAGE_BLOCK_REQUEST) {
+		writer.begin(ZCL_FRAME_TYPE_CLUSTER | ZCL_SERVER_TO_CLIENT | ZCL_DISABLE_DEFAULT_RESPONSE, client->transactionSequence, ZCL_OTA_IMAGE_BLOCK_RESPONSE);
+		length = writeBlockResponse(*client, writer, size);
+	} else {
+		// upgrade now
+		writer.begin(ZCL_FRAME_TYPE_CLUSTER | ZCL_SERVER_TO_CLIENT | ZCL_DISABLE_DEFAULT_RESPONSE, client->transactionSequence, ZCL_OTA_UPGRADE_END_RESPONSE);
+		writer.write16(client->manufacturerCode);
+		writer.write16(client->imageType);
+		writer.write32(client->fileVersion);
+		writer.write32(0);
+		writer.write32(0);
+		length = writer.getLength();
+	}
+
+	_xbee->send(tx, length);
+	_lastSend = now;
+
+	return true;
+}
+
+#endif // SERIES_2
@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XBee_ZclOta_h
+#define XBee_ZclOta_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+#include "Zcl.h"
+
+#ifdef SERIES_2
+
+#define ZCL_OTA_CLUSTER_ID 0x0019
+
+// OTA Upgrade cluster commands
+#define ZCL_OTA_IMAGE_NOTIFY 0x00
+#define ZCL_OTA_QUERY_NEXT_IMAGE_REQUEST 0x01
+#define ZCL_OTA_QUERY_NEXT_IMAGE_RESPONSE 0x02
+#define ZCL_OTA_IMAGE_BLOCK_REQUEST 0x03
+#define ZCL_OTA_IMAGE_BLOCK_RESPONSE 0x05
+#define ZCL_OTA_UPGRADE_END_REQUEST 0x06
+#define ZCL_OTA_UPGRADE_END_RESPONSE 0x07
+
+// OTA status codes
+#define ZCL_OTA_ABORT 0x95
+#define ZCL_OTA_INVALID_IMAGE 0x96
+#define ZCL_OTA_WAIT_FOR_DATA 0x97
+
+// Size of the OTA file header fields read by the server
+#define ZCL_OTA_HEADER_SIZE 56
+#define ZCL_OTA_FILE_IDENTIFIER 0x0BEEF11EUL
+
+// Images an OtaServer can serve
+#define OTA_SERVER_IMAGES 2
+// Largest ZB payload sent, the actual size is limited by NP
+#ifndef OTA_SERVER_MAX_PAYLOAD
+#define OTA_SERVER_MAX_PAYLOAD 84
+#endif
+// Image Block Response bytes before the data
+#define OTA_SERVER_BLOCK_OVERHEAD 17
+// Default minimum milliseconds between frames sent by loop()
+#define OTA_SERVER_MIN_INTERVAL 20
+// Query jitter sent in Image Notify, clients query when a random
+// number from 1 to 100 is at most this
+#define OTA_SERVER_NOTIFY_JITTER 100
+
+/**
+ * Where an OtaServer reads an OTA upgrade file (the image, including
+ * its OTA header) from. Implement this for e.g. an SPI flash chip or an
+ * SD card file.
+ */
+class OtaImageSource {
+public:
+	/**
+	 * Returns the size of the file
+	 */
+	virtual uint32_t getSize() = 0;
+	/**
+	 * Copies length bytes at offset into buffer, returns false on
+	 * errors. Blocks are read directly into the TX frame.
+	 */
+	virtual bool read(uint32_t offset, uint8_t *buffer, uint8_t length) = 0;
+};
+
+/**
+ * An image in memory, e.g. an array or a memory mapped file
+ */
+class OtaMemorySource : public OtaImageSource {
+public:
+	OtaMemorySource(const uint8_t *data, uint32_t size) : _data(data), _size(size) {}
+
+	uint32_t getSize() { return _size; }
+	bool read(uint32_t offset, uint8_t *buffer, uint8_t length);
+protected:
+	const uint8_t *_data;
+	uint32_t _size;
+};
+
+#ifndef ARDUINO
+/**
+ * An image in a file on the host, mapped in memory so blocks are
+ * copied straight from the page cache into the TX frame.
+ */
+class OtaFileSource : public OtaMemorySource {
+public:
+	OtaFileSource(const char *path);
+	~OtaFileSource();
+
+	bool isOpen() { return _data != NULL; }
+};
+#endif
+
+#define OTA_CLIENT_IDLE 0xff
+
+/**
+ * A node upgrading from an OtaServer, and its pending request
+ */
+struct OtaClient {
+	XBeeAddress64 address;
+	uint8_t endpoint;
+	// Command id of the request to answer, OTA_CLIENT_IDLE if none
+	uint8_t request;
+	uint8_t transactionSequence;
+	// Fields of the request
+	uint16_t manufacturerCode;
+	uint16_t imageType;
+	uint32_t fileVersion;
+	uint32_t offset;
+	uint8_t maxDataSize;
+	// Status of the Upgrade End Request
+	uint8_t status;
+	// millis() of the last request
+	uint32_t time;
+	// Image bytes sent
+	uint32_t bytesSent;
+};
+
+/**
+ * A ZigBee OTA Upgrade cluster server, answering Query Next Image,
+ * Image Block and Upgrade End requests from OtaImageSources.
+ *
+ * Requests are recorded (as an XBeeObserver) in a table of clients
+ * supplied by the caller, so many nodes can upgrade at the same time.
+ * loop() answers one pending request per call, taking turns between
+ * clients and waiting at least the minimum interval between frames,
+ * to keep the upgrade from saturating the network. When the table is
+ * full, requests from new nodes are ignored until an entry without a
+ * pending request can be reused; clients retry on their own.
+ *
+ * Block sizes are the smallest of what the client asks for,
+ * OTA_SERVER_MAX_PAYLOAD and the radio's maximum payload (NP), which
+ * is read with requestMaxPayloadSize() or set with
+ * setMaxPayloadSize().
+ *
+ * Example:
+ *
+ * OtaClient clients[4];
+ * OtaServer ota(xbee, clients, 4);
+ * SpiFlashSource image;
+ *
+ * void setup() {
+ *   xbee.addObserver(ota);
+ *   ota.addImage(image);
+ *   ota.requestMaxPayloadSize();
+ *   ota.notify(sensor, 1);
+ * }
+ *
+ * void loop() {
+ *   xbee.loop();
+ *   ota.loop();
+ * }
+ */
+class OtaServer : public XBeeObserver {
+public:
+	OtaServer(XBee &xbee, OtaClient *clients, uint8_t size, uint8_t localEndpoint = 1, uint16_t profileId = ZCL_HA_PROFILE_ID);
+
+	/**
+	 * Adds an image, returns false if its OTA header is invalid or
+	 * there is no room for it. The source must stay valid.
+	 */
+	bool addImage(OtaImageSource &source);
+
+	/**
+	 * Sends an AT NP query, the answer sets the maximum payload size
+	 */
+	void requestMaxPayloadSize();
+	void setMaxPayloadSize(uint8_t size);
+	uint8_t getMaxPayloadSize() { return _maxPayload; }
+	/**
+	 * Minimum milliseconds between frames sent by loop(), defaults to
+	 * OTA_SERVER_MIN_INTERVAL
+	 */
+	void setMinInterval(uint16_t interval) { _minInterval = interval; }
+
+	/**
+	 * Sends an Image Notify, telling the node (or all nodes when sent
+	 * to the broadcast address) to query for a new image
+	 */
+	void notify(XBeeAddress64 &address, uint8_t endpoint);
+
+	/**
+	 * Register a callback that is called by loop() when a client
+	 * reports the end of its upgrade, with the status in
+	 * OtaClient::status.
+	 */
+	void onUpgradeEnd(void (*func)(OtaClient&, uintptr_t), uintptr_t data = 0) {
+		_onUpgradeEnd = func;
+		_onUpgradeEndData = data;
+	}
+
+	/**
+	 * Answers at most one request, returns true if a frame was sent.
+	 * Call this regularly, outside of callbacks.
+	 */
+	bool loop();
+
+	void onResponse(XBeeResponse &response);
+
+	uint8_t getClientCount() { return _count; }
+	OtaClient* getClient(uint8_t index) { return index < _count ? &_clients[index] : NULL; }
+private:
+	struct Image {
+		OtaImageSource *source;
+		uint16_t manufacturerCode;
+		uint16_t imageType;
+		uint32_t fileVersion;
+		uint32_t size;
+	};
+
+	Image* findImage(uint16_t manufacturerCode, uint16_t imageType);
+	OtaClient* getClient(XBeeAddress64 &address);
+	void handleRequest(ZBExplicitRxResponse &rx);
+	void writeQueryResponse(OtaClient &client, ZclWriter &writer);
+	uint8_t writeBlockResponse(OtaClient &client, ZclWriter &writer, uint8_t size);
+
+	XBee* _xbee;
+	OtaClient* _clients;
+	uint8_t _size;
+	uint8_t _count;
+	uint8_t _next;
+	uint8_t _localEndpoint;
+	uint16_t _profileId;
+	Image _images[OTA_SERVER_IMAGES];
+	uint8_t _imageCount;
+	uint8_t _maxPayload;
+	uint8_t _npFrameId;
+	uint16_t _minInterval;
+	uint32_t _lastSend;
+	void (*_onUpgradeEnd)(OtaClient&, uintptr_t);
+	uintptr_t _onUpgradeEndData;
+};
+
+#endif // SERIES_2
+
+#endif // XBee_ZclOta_h
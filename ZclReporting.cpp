@@ -0,0 +1,312 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ZclReporting.h"
+
+#ifdef SERIES_2
+
+static bool sameAddress(XBeeAddress64 &a, XBeeAddress64 &b) {
+	return a.getMsb() == b.getMsb() && a.getLsb() == b.getLsb();
+}
+
+static uint8_t getRecordSize(ZclReportBinding &binding) {
+	// direction, attribute id, type, min and max interval, then the
+	// reportable change for analog types
+	return 8 + (zclIsAnalog(binding.type) ? zclGetTypeSize(binding.type) : 0);
+}
+
+static bool sameGroup(ZclReportBinding &a, ZclReportBinding &b) {
+	return sameAddress(a.address, b.address) && a.endpoint == b.endpoint && a.clusterId == b.clusterId;
+}
+
+ZclReporting::ZclReporting(XBee &xbee, ZclReportBinding *bindings, uint8_t size, uint8_t localEndpoint, uint16_t profileId) {
+	_xbee = &xbee;
+	_bindings = bindings;
+	_size = size;
+	_localEndpoint = localEndpoint;
+	_profileId = profileId;
+	_transactionSequence = 0;
+	_timeout = ZCL_REPORTING_TIMEOUT;
+	_unmatched = 0;
+	clear();
+}
+
+void ZclReporting::clear() {
+	_count = 0;
+}
+
+ZclReportBinding* ZclReporting::add(XBeeAddress64 &address, uint8_t endpoint, uint16_t clusterId, uint16_t attributeId, uint8_t type, uint16_t minInterval, uint16_t maxInterval, uint32_t reportableChange, void (*func)(ZclReportBinding&, ZclAttribute&, uintptr_t), uintptr_t data) {
+	if (_count == _size) {
+		return NULL;
+	}
+
+	ZclReportBinding *binding = &_bindings[_count++];
+	binding->address = address;
+	binding->endpoint = endpoint;
+	binding->clusterId = clusterId;
+	binding->attributeId = attributeId;
+	binding->type = type;
+	binding->minInterval = minInterval;
+	binding->maxInterval = maxInterval;
+	binding->reportableChange = reportableChange;
+	binding->func = func;
+	binding->data = data;
+	binding->state = ZCL_REPORTING_UNCONFIGURED;
+	binding->status = ZCL_SUCCESS;
+	binding->transactionSequence = 0;
+	binding->time = 0;
+	binding->reports = 0;
+
+	return binding;
+}
+
+void ZclReporting::remove(XBeeAddress64 &address) {
+	uint8_t kept = 0;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		if (!sameAddress(_bindings[i].address, address)) {
+			if (kept != i) {
+				_bindings[kept] = _bindings[i];
+			}
+
+			kept++;
+		}
+	}
+
+	_count = kept;
+}
+
+void ZclReporting::reconfigure(XBeeAddress64 &address) {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (sameAddress(_bindings[i].address, address)) {
+			_bindings[i].state = ZCL_REPORTING_UNCONFIGURED;
+		}
+	}
+}
+
+void ZclReporting::reconfigure() {
+	for (uint8_t i = 0; i < _count; i++) {
+		_bindings[i].state = ZCL_REPORTING_UNCONFIGURED;
+	}
+}
+
+bool ZclReporting::loop() {
+	uint32_t now = millis();
+	ZclReportBinding *first = NULL;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		ZclReportBinding *binding = &_bindings[i];
+
+		if (binding->state == ZCL_REPORTING_PENDING && now - binding->time >= _timeout) {
+			// no response, try again
+			binding->state = ZCL_REPORTING_UNCONFIGURED;
+		}
+
+		if (first == NULL && binding->state == ZCL_REPORTING_UNCONFIGURED) {
+			first = binding;
+		}
+	}
+
+	if (first == NULL) {
+		return false;
+	}
+
+	uint8_t buffer[XBEE_TX_BUFFER_SIZE(3 + ZCL_REPORTING_GROUP * ZCL_REPORTING_RECORD_SIZE)];
+	XBeeTxBuffer tx(buffer, sizeof(buffer));
+	uint8_t *payload = tx.beginZBExplicitTx(first->address, ZB_BROADCAST_ADDRESS, 0, 0, _localEndpoint, first->endpoint, first->clusterId, _profileId, _xbee->getNextFrameId());
+	ZclWriter writer(payload, tx.getMaxPayloadLength());
+	uint8_t sequence = ++_transactionSequence;
+	uint8_t records = 0;
+
+	writer.begin(ZCL_FRAME_TYPE_GLOBAL, sequence, ZCL_CONFIGURE_REPORTING);
+
+	for (ZclReportBinding *binding = first; binding < _bindings + _count && records < ZCL_REPORTING_GROUP; binding++) {
+		if (binding->state != ZCL_REPORTING_UNCONFIGURED || !sameGroup(*binding, *first)) {
+			continue;
+		}
+
+		if (writer.getLength() + getRecordSize(*binding) > tx.getMaxPayloadLength()) {
+			// sent in a later frame
+			break;
+		}
+
+		writer.addReportingConfiguration(binding->attributeId, binding->type, binding->minInterval, binding->maxInterval, binding->reportableChange);
+		binding->state = ZCL_REPORTING_PENDING;
+		binding->transactionSequence = sequence;
+		binding->time = now;
+		records++;
+	}
+
+	if (records == 0 || writer.isOverflow()) {
+		// cannot happen with the sizes above, but never send a cut off
+		// configuration
+		first->state = ZCL_REPORTING_REJECTED;
+		first->status = ZCL_INSUFFICIENT_SPACE;
+		return false;
+	}
+
+	_xbee->send(tx, writer.getLength());
+
+	return true;
+}
+
+void ZclReporting::setPendingState(XBeeAddress64 &address, uint8_t transactionSequence, uint8_t state, uint8_t status) {
+	for (uint8_t i = 0; i < _count; i++) {
+		ZclReportBinding *binding = &_bindings[i];
+
+		if (binding->state == ZCL_REPORTING_PENDING && binding->transactionSequence == transactionSequence && sameAddress(binding->address, address)) {
+			binding->state = state;
+			binding->status = status;
+		}
+	}
+}
+
+void ZclReporting::onResponse(XBeeResponse &response) {
+	uint8_t id = response.getApiId();
+
+	if (id == ZB_EXPLICIT_RX_RESPONSE) {
+		ZBExplicitRxResponse rx;
+		response.getZBExplicitRxResponse(rx);
+
+		if (rx.getProfileId() == ZDO_PROFILE_ID && rx.getClusterId() == ZDO_DEVICE_ANNOUNCE) {
+			// sequence, 16-bit address, 64-bit address (little-endian), capabilities
+			ZclReader reader(rx.getData(), rx.getDataLength());
+			reader.readBytes(3);
+			uint32_t lsb = reader.read32();
+			uint32_t msb = reader.read32();
+
+			if (!reader.isError()) {
+				XBeeAddress64 address(msb, lsb);
+				reconfigure(address);
+			}
+		} else if (rx.getProfileId() == _profileId) {
+			handleZcl(rx);
+		}
+	} else if (id == ZB_IO_NODE_IDENTIFIER_RESPONSE) {
+		// starts with the 64-bit source address, like a ZB RX
+		ZBRxResponse rx;
+		response.getZBRxResponse(rx);
+		reconfigure(rx.getRemoteAddress64());
+	} else if (id == MODEM_STATUS_RESPONSE) {
+		ModemStatusResponse status;
+		response.getModemStatusResponse(status);
+
+		if (status.getStatus() == COORDINATOR_STARTED) {
+			reconfigure();
+		}
+	}
+}
+
+void ZclReporting::handleZcl(ZBExplicitRxResponse &rx) {
+	ZclFrame frame;
+
+	if (!frame.parse(rx) || frame.isClusterSpecific()) {
+		return;
+	}
+
+	switch (frame.getCommandId()) {
+		case ZCL_CONFIGURE_REPORTING_RESPONSE:
+			handleConfigureResponse(rx.getRemoteAddress64(), frame);
+			break;
+		case ZCL_DEFAULT_RESPONSE:
+			handleDefaultResponse(rx.getRemoteAddress64(), frame);
+			break;
+		case ZCL_REPORT_ATTRIBUTES:
+		case ZCL_READ_ATTRIBUTES_RESPONSE:
+			handleReport(rx, frame);
+			break;
+	}
+}
+
+void ZclReporting::handleConfigureResponse(XBeeAddress64 &address, ZclFrame &frame) {
+	ZclReader reader = frame.getPayload();
+	uint8_t sequence = frame.getTransactionSequence();
+
+	// a single status when all attributes succeeded, else a status,
+	// direction and attribute id for each failed attribute
+	while (reader.getRemaining() >= 4) {
+		uint8_t status = reader.read8();
+		reader.read8();
+		uint16_t attributeId = reader.read16();
+
+		for (uint8_t i = 0; i < _count; i++) {
+			ZclReportBinding *binding = &_bindings[i];
+
+			if (binding->state == ZCL_REPORTING_PENDING && binding->transactionSequence == sequence && binding->attributeId == attributeId && sameAddress(binding->address, address)) {
+				binding->state = status == ZCL_SUCCESS ? ZCL_REPORTING_CONFIGURED : ZCL_REPORTING_REJECTED;
+				binding->status = status;
+			}
+		}
+	}
+
+	if (reader.getRemaining() == 1 && reader.read8() != ZCL_SUCCESS) {
+		// failed as a whole
+		setPendingState(address, sequence, ZCL_REPORTING_REJECTED, ZCL_FAILURE);
+	}
+
+	setPendingState(address, sequence, ZCL_REPORTING_CONFIGURED, ZCL_SUCCESS);
+}
+
+void ZclReporting::handleDefaultResponse(XBeeAddress64 &address, ZclFrame &frame) {
+	ZclReader reader = frame.getPayload();
+	uint8_t commandId = reader.read8();
+	uint8_t status = reader.read8();
+
+	if (!reader.isError() && commandId == ZCL_CONFIGURE_REPORTING && status != ZCL_SUCCESS) {
+		setPendingState(address, frame.getTransactionSequence(), ZCL_REPORTING_REJECTED, status);
+	}
+}
+
+void ZclReporting::handleReport(ZBExplicitRxResponse &rx, ZclFrame &frame) {
+	ZclAttributeReader reader(frame);
+	ZclAttribute attribute;
+	uint32_t now = millis();
+
+	while (reader.next(attribute)) {
+		if (attribute.getStatus() != ZCL_SUCCESS) {
+			continue;
+		}
+
+		bool matched = false;
+
+		for (uint8_t i = 0; i < _count; i++) {
+			ZclReportBinding *binding = &_bindings[i];
+
+			if (binding->attributeId == attribute.getId() && binding->clusterId == rx.getClusterId() && binding->endpoint == rx.getSrcEndpoint() && sameAddress(binding->address, rx.getRemoteAddress64())) {
+				matched = true;
+				binding->time = binding->state == ZCL_REPORTING_PENDING ? binding->time : now;
+
+				if (binding->reports != 0xffff) {
+					binding->reports++;
+				}
+
+				if (binding->func) {
+					binding->func(*binding, attribute, binding->data);
+				}
+			}
+		}
+
+		if (!matched && _unmatched != 0xffff) {
+			_unmatched++;
+		}
+	}
+}
+
+#endif // SERIES_2
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2009 Andrew Rapp. All rights reserved.
+ *
+ * This file is part of XBee-Arduino.
+ *
+ * XBee-Arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * XBee-Arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with XBee-Arduino.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XBee_ZclReporting_h
+#define XBee_ZclReporting_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "XBee.h"
+#include "Zcl.h"
+
+#ifdef SERIES_2
+
+// Milliseconds to wait for a Configure Reporting Response before
+// sending the configuration again
+#define ZCL_REPORTING_TIMEOUT 10000
+// Most attributes configured by one Configure Reporting frame
+#define ZCL_REPORTING_GROUP 4
+// Size of a reporting configuration record with a 32-bit change, the
+// frame buffer fits ZCL_REPORTING_GROUP of these. Records with larger
+// changes (64-bit, double) go in fewer per frame.
+#define ZCL_REPORTING_RECORD_SIZE 12
+
+// ZDO device announce, sent by a device when it (re)joins
+#define ZDO_PROFILE_ID 0x0000
+#define ZDO_DEVICE_ANNOUNCE 0x0013
+
+// Binding states
+#define ZCL_REPORTING_UNCONFIGURED 0
+#define ZCL_REPORTING_PENDING 1
+#define ZCL_REPORTING_CONFIGURED 2
+#define ZCL_REPORTING_REJECTED 3
+
+struct ZclReportBinding;
+
+/**
+ * An attribute of a remote node that should report on its own, and
+ * where to pass its reports. Use ZclReporting::add() to fill these.
+ */
+struct ZclReportBinding {
+	XBeeAddress64 address;
+	uint8_t endpoint;
+	uint16_t clusterId;
+	uint16_t attributeId;
+	uint8_t type;
+	uint16_t minInterval;
+	uint16_t maxInterval;
+	uint32_t reportableChange;
+	void (*func)(ZclReportBinding&, ZclAttribute&, uintptr_t);
+	uintptr_t data;
+
+	// One of the ZCL_REPORTING_* states
+	uint8_t state;
+	// ZCL status the configuration was rejected with
+	uint8_t status;
+	// Transaction sequence of the last Configure Reporting sent
+	uint8_t transactionSequence;
+	// millis() when the configuration was sent, or of the last report
+	uint32_t time;
+	// Reports received
+	uint16_t reports;
+};
+
+/**
+ * Has remote nodes report attributes when they change, instead of
+ * polling them, using ZCL Configure Reporting.
+ *
+ * Attributes to report are added to a table of bindings supplied by
+ * the caller. loop() sends a Configure Reporting command for bindings
+ * that are not configured yet, grouping the attributes of the same
+ * node, endpoint and cluster in one frame (one frame per call), and
+ * sends it again when no response arrives. The state of each binding
+ * follows the Configure Reporting Response (or a Default Response
+ * rejecting the command).
+ *
+ * Incoming reports (and read attributes responses) are passed to the
+ * callback of the matching binding. As this is an XBeeObserver, the
+ * callbacks run from inside readPacket() and must not send or read
+ * packets themselves.
+ *
+ * When a node announces it (re)joined the network (ZDO device
+ * announce, which the radio only passes on with AO=1 or 3, or a node
+ * identification frame), its bindings are configured again, all of
+ * them when the coordinator restarts the network (modem status).
+ *
+ * Example:
+ *
+ * void temperature(ZclReportBinding &b, ZclAttribute &attr, uintptr_t) {
+ *   Serial.println(attr.getInt() / 100.0);
+ * }
+ *
+ * ZclReportBinding bindings[4];
+ * ZclReporting reporting(xbee, bindings, 4);
+ *
+ * void setup() {
+ *   xbee.addObserver(reporting);
+ *   // temperature measurement, at most every 10 s, at least every 5 min
+ *   reporting.add(sensor, 1, 0x0402, 0x0000, ZCL_INT16, 10, 300, 50, temperature);
+ * }
+ *
+ * void loop() {
+ *   xbee.loop();
+ *   reporting.loop();
+ * }
+ */
+class ZclReporting : public XBeeObserver {
+public:
+	ZclReporting(XBee &xbee, ZclReportBinding *bindings, uint8_t size, uint8_t localEndpoint = 1, uint16_t profileId = ZCL_HA_PROFILE_ID);
+
+	/**
+	 * Adds a binding, returns it or NULL if the table is full. The
+	 * reportable change is ignored for discrete types.
+	 */
+	ZclReportBinding* add(XBeeAddress64 &address, uint8_t endpoint, uint16_t clusterId, uint16_t attributeId, uint8_t type, uint16_t minInterval, uint16_t maxInterval, uint32_t reportableChange, void (*func)(ZclReportBinding&, ZclAttribute&, uintptr_t), uintptr_t data = 0);
+	/**
+	 * Removes the bindings of a node. This moves other bindings, so
+	 * pointers returned by add() are no longer valid.
+	 */
+	void remove(XBeeAddress64 &address);
+	void clear();
+
+	uint8_t getCount() { return _count; }
+	ZclReportBinding* getBinding(uint8_t index) { return index < _count ? &_bindings[index] : NULL; }
+
+	/**
+	 * Has the bindings of a node, or all bindings, configured again
+	 */
+	void reconfigure(XBeeAddress64 &address);
+	void reconfigure();
+
+	/**
+	 * Sends at most one Configure Reporting command. Call this
+	 * regularly, outside of callbacks. Returns true if a frame was sent.
+	 */
+	bool loop();
+
+	void onResponse(XBeeResponse &response);
+
+	/**
+	 * Reported attributes that did not match a binding
+	 */
+	uint16_t getUnmatched() { return _unmatched; }
+	void setTimeout(uint16_t timeout) { _timeout = timeout; }
+private:
+	void handleZcl(ZBExplicitRxResponse &rx);
+	void handleConfigureResponse(XBeeAddress64 &address, ZclFrame &frame);
+	void handleDefaultResponse(XBeeAddress64 &address, ZclFrame &frame);
+	void handleReport(ZBExplicitRxResponse &rx, ZclFrame &frame);
+	void setPendingState(XBeeAddress64 &address, uint8_t transactionSequence, uint8_t state, uint8_t status);
+
+	XBee* _xbee;
+	ZclReportBinding* _bindings;
+	uint8_t _size;
+	uint8_t _count;
+	uint8_t _localEndpoint;
+	uint16_t _profileId;
+	uint8_t _transactionSequence;
+	uint16_t _timeout;
+	uint16_t _unmatched;
+};
+
+#endif // SERIES_2
+
+#endif // XBee_ZclReporting_h
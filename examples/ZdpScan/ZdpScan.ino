@@ -19,10 +19,12 @@
 /*
  This example is for Series 2 XBee.
 
- It discovers up to 10 nodes on the Zigbee network by recursively fetching
- neighbour tables from all routers and presents the result on the serial
- console. A node can be selected to be further examined, which will then
- be queried (using messages from the Zigbee Device Profile) for the
+ It discovers up to MAX_NODES nodes on the Zigbee network by fetching
+ neighbour tables from several routers at the same time and presents the
+ discovered nodes and links on the serial console. Later scans can be
+ limited to the parts of the network that changed. One of the first ten
+ nodes can be selected to be further examined, which will then be
+ queried (using messages from the Zigbee Device Profile) for the
  endpoints, profiles and clusters it supports.
 
  This example assumes an Arduino with two serial ports (like the
@@ -264,159 +266,495 @@ void invertEndian(uint8_t *buf, size_t len) {
   }
 }
 
+/**
+ * Size limits for the network scan. Each node takes 17 bytes of RAM and
+ * each link 6 bytes, so these can be raised considerably on boards with
+ * more memory than a Leonardo (node and link indices are 16 bits, so up
+ * to 65534 each). MAX_INFLIGHT is the number of neighbour table
+ * requests that are outstanding at the same time.
+ */
+#define MAX_NODES 32
+#define MAX_LINKS 64
+#define MAX_INFLIGHT 4
+
+// How long to wait for a neighbour table page before retrying it (see
+// handleZdoRequest for the reasoning behind 5000) and how often to retry.
+#define LQI_TIMEOUT 5000
+#define LQI_RETRIES 2
+
+#define NO_NODE 0xffff
+
+#if MAX_NODES >= NO_NODE || MAX_LINKS > 0xffff
+#error MAX_NODES and MAX_LINKS must fit the 16-bit indices
+#endif
+
+/**
+ * Scan state of a node.
+ */
+enum {
+  NODE_IDLE,      // Not (yet) scheduled in this scan
+  NODE_QUEUED,    // Waiting for a free request slot
+  NODE_INFLIGHT,  // Neighbour table is being fetched
+  NODE_DONE,      // Handled in this scan
+};
+
 /**
  * Struct to keep info about discovered nodes.
  */
 struct node_info {
   XBeeAddress64 addr64;
   uint16_t addr16;
+  // Hash of the neighbour table topology (addresses, types and
+  // relationships, but not the constantly changing LQI), used to decide
+  // whether a subtree must be rescanned.
+  uint16_t table_hash;
+  uint16_t new_hash;
+  // Index of the node this node was first discovered through
+  uint16_t parent;
   uint8_t type: 2;
-  uint8_t visited: 1;
+  uint8_t state: 2;
+  // Set when the node is new, changed address or could not be queried,
+  // so the next incremental scan queries it again.
+  uint8_t dirty: 1;
+};
+
+/**
+ * A link between a node and an entry in its neighbour table.
+ */
+struct link_info {
+  uint16_t from;
+  uint16_t to;
+  uint8_t lqi;
+  uint8_t depth: 4;
+  uint8_t relationship: 3;
+  uint8_t stale: 1;
 };
 
 /**
- * List of nodes found.
+ * An outstanding Mgmt_Lqi request.
+ */
+struct lqi_request {
+  uint16_t node;        // NO_NODE when this slot is unused
+  uint8_t transaction;
+  uint8_t frame_id;
+  uint8_t start_index;
+  uint8_t retries;
+  unsigned long sent;
+};
+
+/**
+ * List of nodes and links found.
+ */
+node_info nodes[MAX_NODES];
+uint16_t nodes_found = 0;
+link_info links[MAX_LINKS];
+uint16_t links_found = 0;
+lqi_request inflight[MAX_INFLIGHT];
+
+// Our operating PAN ID, in little endian, to filter the LQI results
+uint8_t pan_id[8];
+
+uint16_t findNode(uint64_t addr) {
+  for (uint16_t i = 0; i < nodes_found; ++i) {
+    if (nodes[i].addr64.get() == addr)
+      return i;
+  }
+  return NO_NODE;
+}
+
+void printNode(uint16_t i) {
+  node_info *n = &nodes[i];
+  Serial.print(i);
+  Serial.print(F(") 0x"));
+  printHex(Serial, n->addr64);
+  Serial.print(F(" (0x"));
+  printHex(Serial, n->addr16);
+  if (i == 0) {
+    Serial.println(F(", Self)"));
+    return;
+  }
+  switch (n->type) {
+    case ZDO_MGMT_LQI_REQ_TYPE_COORDINATOR:
+      Serial.println(F(", Coordinator)"));
+      break;
+    case ZDO_MGMT_LQI_REQ_TYPE_ROUTER:
+      Serial.println(F(", Router)"));
+      break;
+    case ZDO_MGMT_LQI_REQ_TYPE_ENDDEVICE:
+      Serial.println(F(", End device)"));
+      break;
+    case ZDO_MGMT_LQI_REQ_TYPE_UNKNOWN:
+      Serial.println(F(", Unknown)"));
+      break;
+  }
+}
+
+void printLinks() {
+  for (uint16_t i = 0; i < links_found; ++i) {
+    link_info *l = &links[i];
+    Serial.print(F("  0x"));
+    printHex(Serial, nodes[l->from].addr16);
+    Serial.print(F(" -> 0x"));
+    printHex(Serial, nodes[l->to].addr16);
+    Serial.print(F(" LQI: "));
+    Serial.print(l->lqi);
+    Serial.print(F(" Depth: "));
+    Serial.print(l->depth);
+    switch (l->relationship) {
+      case ZDO_MGMT_LQI_REL_PARENT: Serial.println(F(" (Parent)")); break;
+      case ZDO_MGMT_LQI_REL_CHILD: Serial.println(F(" (Child)")); break;
+      case ZDO_MGMT_LQI_REL_SIBLING: Serial.println(F(" (Sibling)")); break;
+      case ZDO_MGMT_LQI_REL_PREVIOUS_CHILD: Serial.println(F(" (Previous child)")); break;
+      default: Serial.println(); break;
+    }
+  }
+}
+
+/**
+ * Schedule the neighbour table of a node to be fetched. End devices do
+ * not have a neighbour table, so those are skipped.
  */
-node_info nodes[10];
-uint8_t nodes_found = 0;
+void queueNode(uint16_t i) {
+  if (nodes[i].state != NODE_IDLE)
+    return;
+  if (nodes[i].type == ZDO_MGMT_LQI_REQ_TYPE_ENDDEVICE)
+    nodes[i].state = NODE_DONE;
+  else
+    nodes[i].state = NODE_QUEUED;
+}
 
 /**
- * Scan the network and discover all other nodes by traversing neighbour
- * tables. The discovered nodes are stored in the nodes array.
+ * Add a link or update an existing one.
  */
-void scan_network() {
+void setLink(uint16_t from, uint16_t to, uint8_t lqi, uint8_t depth, uint8_t relationship) {
+  link_info *l;
+  uint16_t i;
+  for (i = 0; i < links_found; ++i) {
+    if (links[i].from == from && links[i].to == to)
+      break;
+  }
+  if (i == links_found) {
+    if (links_found == MAX_LINKS) {
+      Serial.println(F("Link table full, ignoring link"));
+      return;
+    }
+    links_found++;
+  }
+  l = &links[i];
+  l->from = from;
+  l->to = to;
+  l->lqi = lqi;
+  l->depth = depth;
+  l->relationship = relationship;
+  l->stale = false;
+}
+
+/**
+ * Send (or resend) the Mgmt_Lqi request for the given slot.
+ */
+void sendLqiRequest(lqi_request *r) {
+  zdo_mgmt_lqi_req_t payload = {
+    .transaction = getNextTransactionId(),
+    .start_index = r->start_index,
+  };
+  ZBExplicitTxRequest tx = buildZdoRequest(nodes[r->node].addr64, ZDO_MGMT_LQI_REQ, (uint8_t*)&payload, sizeof(payload));
+  xbee.send(tx);
+
+  r->transaction = payload.transaction;
+  r->frame_id = tx.getFrameId();
+  r->sent = millis();
+}
+
+/**
+ * Done with the node in the given slot. When its neighbour table
+ * topology changed (or it was never scanned before), schedule all of
+ * its neighbours as well. When it did not change, the subtree behind it
+ * is assumed unchanged too, and only neighbours that are known to have
+ * changed are scheduled.
+ */
+void finishNode(lqi_request *r, bool ok) {
+  uint16_t i = r->node;
+  node_info *n = &nodes[i];
+  r->node = NO_NODE;
+  n->state = NODE_DONE;
+
+  if (!ok) {
+    // Try again on the next incremental scan
+    n->dirty = true;
+    return;
+  }
+
+  // Remove links that were not in the neighbour table anymore
+  for (uint16_t l = 0; l < links_found;) {
+    if (links[l].from == i && links[l].stale)
+      links[l] = links[--links_found];
+    else
+      ++l;
+  }
+
+  bool changed = n->dirty || n->new_hash != n->table_hash;
+  n->table_hash = n->new_hash;
+  n->dirty = false;
+
+  for (uint16_t l = 0; l < links_found; ++l) {
+    if (links[l].from == i && (changed || nodes[links[l].to].dirty))
+      queueNode(links[l].to);
+  }
+}
+
+/**
+ * Called when a request was not answered or could not be delivered.
+ */
+void lqiFailed(lqi_request *r) {
+  if (r->retries < LQI_RETRIES) {
+    r->retries++;
+    sendLqiRequest(r);
+    return;
+  }
+
+  Serial.print(F("No neighbour table received from 0x"));
+  printHex(Serial, nodes[r->node].addr16);
   Serial.println();
-  Serial.println("Discovering devices");
-  // Fetch our operating PAN ID, to filter the LQI results
-  uint8_t pan_id[8];
-  getAtValue((uint8_t*)"OP", pan_id, sizeof(pan_id));
-  // XBee sends in big-endian, but ZDO requests use little endian. For
-  // easy comparsion, convert to little endian
-  invertEndian(pan_id, sizeof(pan_id));
-
-  // Fetch the addresses of the local node
-  XBeeAddress64 local;
-  uint8_t shbuf[4], slbuf[4], mybuf[2];
-  if (!getAtValue((uint8_t*)"SH", shbuf, sizeof(shbuf)) ||
-      !getAtValue((uint8_t*)"SL", slbuf, sizeof(slbuf)) ||
-      !getAtValue((uint8_t*)"MY", mybuf, sizeof(mybuf)))
+  finishNode(r, false);
+}
+
+void handleLqiResponse(lqi_request *r, zdo_mgmt_lqi_rsp_t *rsp) {
+  node_info *from = &nodes[r->node];
+
+  if (rsp->status != 0) {
+    if (rsp->status != ZDO_STATUS_NOT_SUPPORTED) {
+      Serial.print(F("LQI query rejected by 0x"));
+      printHex(Serial, from->addr16);
+      Serial.print(F(". Status: 0x"));
+      printHex(Serial, rsp->status);
+      Serial.println();
+    }
+    finishNode(r, false);
     return;
+  }
 
-  nodes[0].addr64.setMsb((uint32_t)shbuf[0] << 24 | (uint32_t)shbuf[1] << 16 | (uint32_t)shbuf[2] << 8 | shbuf[3]);
-  nodes[0].addr64.setLsb((uint32_t)slbuf[0] << 24 | (uint32_t)slbuf[1] << 16 | (uint32_t)slbuf[2] << 8 | slbuf[3]);
-  nodes[0].addr16 = (uint16_t)mybuf[0] << 8 | mybuf[1];
-  nodes[0].type = ZDO_MGMT_LQI_REQ_TYPE_UNKNOWN;
-  nodes[0].visited = false;
-  nodes_found = 1;
+  if (rsp->start_index != r->start_index) {
+    Serial.println(F("Unexpected start_index, skipping this node"));
+    finishNode(r, false);
+    return;
+  }
 
-  Serial.print(F("0) 0x"));
-  printHex(Serial, nodes[0].addr64);
-  Serial.print(F(" (0x"));
-  printHex(Serial, nodes[0].addr16);
-  Serial.println(F(", Self)"));
-
-  // nodes[0] now contains our own address, the rest is invalid. We
-  // explore the network by asking for LQI info (neighbour table).
-  // Initially, this pretends to send a packet to ourselves, which the
-  // XBee firmware conveniently handles by pretending that a reply was
-  // received (with one caveat: it seems the reply arrives _before_ the
-  // TX status).
-  uint8_t next = 0;
-  do {
-    // Query node i for its LQI table
-    zdo_mgmt_lqi_req_t payload = {
-      .transaction = getNextTransactionId(),
-      .start_index = 0,
-    };
-
-    do {
-      ZBExplicitRxResponse rx;
-      if (!handleZdoRequest(F("requesting LQI/neighbour table"),
-                            rx, nodes[next].addr64, ZDO_MGMT_LQI_REQ,
-                            (uint8_t*)&payload, sizeof(payload)))
-        break;
-
-      zdo_mgmt_lqi_rsp_t *rsp = (zdo_mgmt_lqi_rsp_t*)(rx.getFrameData() + rx.getDataOffset());
-      if (rsp->status != 0) {
-        if (rsp->status != ZDO_STATUS_NOT_SUPPORTED) {
-          Serial.print(F("LQI query rejected by 0x"));
-          printHex(Serial, nodes[next].addr16);
-          Serial.print(F(". Status: 0x"));
-          printHex(Serial, rsp->status);
-          Serial.println();
-        }
-        break;
-      }
+  if (rsp->start_index == 0) {
+    // Start of a new table, mark all existing links as stale so
+    // finishNode can remove the ones not seen again.
+    from->new_hash = 0;
+    for (uint16_t l = 0; l < links_found; ++l) {
+      if (links[l].from == r->node)
+        links[l].stale = true;
+    }
+  }
 
-      if (rsp->start_index != payload.start_index) {
-        Serial.println(F("Unexpected start_index, skipping this node"));
-        break;
-      }
+  for (uint8_t i = 0; i < rsp->list_count; ++i) {
+    zdo_mgmt_lqi_entry_t *e = &rsp->entries[i];
+
+    if (memcmp(&e->extended_pan_id_le, &pan_id, sizeof(pan_id)) != 0) {
+      Serial.println(F("Ignoring node in other PAN"));
+      continue;
+    }
 
-      for (uint8_t i = 0; i < rsp->list_count; ++i) {
-        zdo_mgmt_lqi_entry_t *e = &rsp->entries[i];
-        node_info *n = &nodes[nodes_found];
-
-        if (memcmp(&e->extended_pan_id_le, &pan_id, sizeof(pan_id)) != 0) {
-          Serial.println(F("Ignoring node in other PAN"));
-          continue;
-        }
-
-        // Skip if we know about this node already
-        uint8_t dup;
-        for (dup = 0; dup < nodes_found; ++dup) {
-          if (nodes[dup].addr16 == e->nwk_addr_le)
-            break;
-        }
-        if (dup != nodes_found)
-          continue;
-
-        n->addr64.setMsb(e->extended_addr_le >> 32);
-        n->addr64.setLsb(e->extended_addr_le);
-        n->addr16 = e->nwk_addr_le;
-        n->type = e->flags0 & 0x3;
-
-        Serial.print(nodes_found);
-        Serial.print(F(") 0x"));
-        printHex(Serial, n->addr64);
-        Serial.print(F(" (0x"));
-        printHex(Serial, n->addr16);
-        switch (n->type) {
-          case ZDO_MGMT_LQI_REQ_TYPE_COORDINATOR:
-            Serial.println(F(", Coordinator)"));
-            break;
-          case ZDO_MGMT_LQI_REQ_TYPE_ROUTER:
-            Serial.println(F(", Router)"));
-            break;
-          case ZDO_MGMT_LQI_REQ_TYPE_ENDDEVICE:
-            Serial.println(F(", End device)"));
-            break;
-          case ZDO_MGMT_LQI_REQ_TYPE_UNKNOWN:
-            Serial.println(F(", Unknown)"));
-            break;
-        }
-        nodes_found++;
-
-        if (nodes_found == lengthof(nodes)) {
-          Serial.println(F("Device table full, terminating network scan"));
-          return;
-        }
+    // Rotate-xor hash over the address, type and relationship
+    uint8_t *bytes = (uint8_t*)&e->extended_addr_le;
+    for (uint8_t b = 0; b < sizeof(e->extended_addr_le); ++b)
+      from->new_hash = ((from->new_hash << 5) | (from->new_hash >> 11)) ^ bytes[b];
+    from->new_hash = ((from->new_hash << 5) | (from->new_hash >> 11)) ^ (e->flags0 & 0x73);
+
+    uint16_t to = findNode(e->extended_addr_le);
+    if (to == NO_NODE) {
+      if (nodes_found == MAX_NODES) {
+        Serial.println(F("Device table full, ignoring node"));
+        continue;
       }
+      to = nodes_found++;
+      node_info *n = &nodes[to];
+      n->addr64 = XBeeAddress64(e->extended_addr_le);
+      n->addr16 = e->nwk_addr_le;
+      n->type = e->flags0 & 0x3;
+      n->parent = r->node;
+      n->state = NODE_IDLE;
+      n->table_hash = 0;
+      n->dirty = true;
+      printNode(to);
+    } else if (nodes[to].addr16 != e->nwk_addr_le) {
+      // Rejoined with a new network address
+      nodes[to].addr16 = e->nwk_addr_le;
+      nodes[to].dirty = true;
+    }
+
+    setLink(r->node, to, e->lqi, e->depth,
+            (e->flags0 >> ZDO_MGMT_LQI_REL_SHIFT) & ZDO_MGMT_LQI_REL_MASK);
+  }
+
+  // More left? Request the next page using the same slot.
+  if (rsp->list_count && rsp->start_index + rsp->list_count < rsp->table_entries) {
+    r->start_index += rsp->list_count;
+    r->retries = 0;
+    sendLqiRequest(r);
+    return;
+  }
+
+  finishNode(r, true);
+}
 
-      // Got all neighbours available? Done.
-      if (rsp->start_index + rsp->list_count >= rsp->table_entries)
-        break;
-      // More left? Loop and get more.
-      payload.start_index += rsp->list_count;
-      payload.transaction = getNextTransactionId();
-    } while (true);
-
-    // Done with this node, on to the next
-    nodes[next].visited = true;
-    ++next;
-  } while (next < nodes_found);
-  Serial.println(F("Finished scanning"));
-  Serial.println(F("Press a number to scan that node, or press r to rescan the network"));
+/**
+ * Callback that handles all ZDO replies and announcements received.
+ */
+void zdoReceive(ZBExplicitRxResponse& rx, uintptr_t) {
+  if (rx.getSrcEndpoint() != WPAN_ENDPOINT_ZDO ||
+      rx.getDstEndpoint() != WPAN_ENDPOINT_ZDO ||
+      rx.getProfileId() != WPAN_PROFILE_ZDO)
+    return;
+
+  uint8_t *payload = rx.getFrameData() + rx.getDataOffset();
+
+  if (rx.getClusterId() == ZDO_DEVICE_ANNCE) {
+    // A node (re)joined, so it and the node it joined through need to
+    // be looked at again
+    zdo_device_annce_t *annce = (zdo_device_annce_t*)payload;
+    uint16_t i = findNode(annce->ieee_address_le);
+    if (i != NO_NODE) {
+      nodes[i].addr16 = annce->network_addr_le;
+      nodes[i].dirty = true;
+      nodes[nodes[i].parent].dirty = true;
+      printField(F("Device announce from known node 0x"), annce->network_addr_le);
+    } else {
+      printField(F("Device announce from new node 0x"), annce->network_addr_le);
+    }
+    return;
+  }
+
+  if (rx.getClusterId() != ZDO_MGMT_LQI_RSP)
+    return;
+
+  for (uint8_t i = 0; i < MAX_INFLIGHT; ++i) {
+    if (inflight[i].node != NO_NODE && inflight[i].transaction == payload[0]) {
+      handleLqiResponse(&inflight[i], (zdo_mgmt_lqi_rsp_t*)payload);
+      return;
+    }
+  }
+}
+
+/**
+ * Callback that retries requests that could not be delivered.
+ */
+void zdoTxStatus(ZBTxStatusResponse& status, uintptr_t) {
+  if (status.isSuccess())
+    return;
+
+  for (uint8_t i = 0; i < MAX_INFLIGHT; ++i) {
+    if (inflight[i].node != NO_NODE && inflight[i].frame_id == status.getFrameId()) {
+      lqiFailed(&inflight[i]);
+      return;
+    }
+  }
+}
+
+/**
+ * Handle timeouts and hand out free request slots to queued nodes.
+ * Returns false when the scan is complete.
+ */
+bool crawlStep() {
+  bool active = false;
+  uint16_t next = 0;
+
+  for (uint8_t i = 0; i < MAX_INFLIGHT; ++i) {
+    lqi_request *r = &inflight[i];
+    if (r->node != NO_NODE && millis() - r->sent > LQI_TIMEOUT)
+      lqiFailed(r);
+
+    if (r->node == NO_NODE) {
+      while (next < nodes_found && nodes[next].state != NODE_QUEUED)
+        ++next;
+      if (next == nodes_found)
+        continue;
+
+      r->node = next;
+      r->start_index = 0;
+      r->retries = 0;
+      nodes[next].state = NODE_INFLIGHT;
+      sendLqiRequest(r);
+    }
+    active = true;
+  }
+
+  return active;
+}
+
+/**
+ * Scan the network and discover all other nodes by fetching neighbour
+ * tables from up to MAX_INFLIGHT routers at the same time. The
+ * discovered nodes are stored in the nodes array and the links between
+ * them in the links array.
+ *
+ * When incremental is true, the results of the previous scan are kept
+ * and only the local node, nodes marked dirty, and the neighbours of
+ * nodes whose neighbour table changed are queried.
+ */
+void scan_network(bool incremental = false) {
+  Serial.println();
+  if (incremental && nodes_found) {
+    Serial.println(F("Rescanning changed parts of the network"));
+  } else {
+    Serial.println(F("Discovering devices"));
+    // Fetch our operating PAN ID, to filter the LQI results
+    getAtValue((uint8_t*)"OP", pan_id, sizeof(pan_id));
+    // XBee sends in big-endian, but ZDO requests use little endian. For
+    // easy comparsion, convert to little endian
+    invertEndian(pan_id, sizeof(pan_id));
+
+    // Fetch the addresses of the local node
+    uint8_t shbuf[4], slbuf[4], mybuf[2];
+    if (!getAtValue((uint8_t*)"SH", shbuf, sizeof(shbuf)) ||
+        !getAtValue((uint8_t*)"SL", slbuf, sizeof(slbuf)) ||
+        !getAtValue((uint8_t*)"MY", mybuf, sizeof(mybuf)))
+      return;
+
+    nodes[0].addr64.setMsb((uint32_t)shbuf[0] << 24 | (uint32_t)shbuf[1] << 16 | (uint32_t)shbuf[2] << 8 | shbuf[3]);
+    nodes[0].addr64.setLsb((uint32_t)slbuf[0] << 24 | (uint32_t)slbuf[1] << 16 | (uint32_t)slbuf[2] << 8 | slbuf[3]);
+    nodes[0].addr16 = (uint16_t)mybuf[0] << 8 | mybuf[1];
+    nodes[0].type = ZDO_MGMT_LQI_REQ_TYPE_UNKNOWN;
+    nodes[0].parent = 0;
+    nodes[0].dirty = true;
+    nodes_found = 1;
+    links_found = 0;
+
+    printNode(0);
+  }
+
+  for (uint16_t i = 0; i < nodes_found; ++i)
+    nodes[i].state = NODE_IDLE;
+  for (uint8_t i = 0; i < MAX_INFLIGHT; ++i)
+    inflight[i].node = NO_NODE;
+
+  // We explore the network by asking for LQI info (neighbour table),
+  // starting with ourselves. The XBee firmware conveniently handles a
+  // packet sent to ourselves by pretending that a reply was received
+  // (with one caveat: it seems the reply arrives _before_ the TX
+  // status).
+  queueNode(0);
+  for (uint16_t i = 1; i < nodes_found; ++i) {
+    if (nodes[i].dirty)
+      queueNode(i);
+  }
+
+  unsigned long start = millis();
+  do {
+    xbee.loop();
+  } while (crawlStep());
+
+  Serial.print(F("Finished scanning, "));
+  Serial.print(nodes_found);
+  Serial.print(F(" nodes and "));
+  Serial.print(links_found);
+  Serial.print(F(" links found in "));
+  Serial.print(millis() - start);
+  Serial.println(F("ms"));
+  printLinks();
+  Serial.println(F("Press a number to scan that node, r to rescan the network or i to rescan only changed parts"));
 }
 
 void setup() {
@@ -426,6 +764,8 @@ void setup() {
   xbee.setSerial(Serial1);
 
   xbee.onPacketError(printErrorCb, (uintptr_t)(Print*)&Serial);
+  xbee.onZBExplicitRxResponse(zdoReceive);
+  xbee.onZBTxStatusResponse(zdoTxStatus);
 
   // Set AO=1 to receive explicit RX frames
   // Because this does not write to flash with WR, AO should be reverted
@@ -452,10 +792,12 @@ void loop() {
       int n = c - '0';
       if (n < nodes_found) {
         get_active_endpoints(nodes[n].addr64, nodes[n].addr16);
-        scan_network();
+        scan_network(true);
       }
     } else if (c == 'r') {
       scan_network();
+    } else if (c == 'i') {
+      scan_network(true);
     }
   }
 
@@ -166,6 +166,13 @@ typedef PACKED_STRUCT zdo_mgmt_lqi_entry_t {
 		#define ZDO_MGMT_LQI_REQ_TYPE_ROUTER 0x1
 		#define ZDO_MGMT_LQI_REQ_TYPE_ENDDEVICE 0x2
 		#define ZDO_MGMT_LQI_REQ_TYPE_UNKNOWN 0x3
+		#define ZDO_MGMT_LQI_REL_SHIFT 4
+		#define ZDO_MGMT_LQI_REL_MASK 0x7
+		#define ZDO_MGMT_LQI_REL_PARENT 0x0
+		#define ZDO_MGMT_LQI_REL_CHILD 0x1
+		#define ZDO_MGMT_LQI_REL_SIBLING 0x2
+		#define ZDO_MGMT_LQI_REL_NONE 0x3
+		#define ZDO_MGMT_LQI_REL_PREVIOUS_CHILD 0x4
 	uint8_t flags1;
 	uint8_t depth;
 	uint8_t lqi;
@@ -181,5 +188,20 @@ typedef PACKED_STRUCT zdo_mgmt_lqi_rsp_t {
 	zdo_mgmt_lqi_entry_t		entries[];
 } zdo_mgmt_lqi_rsp_t;
 
+/*********************************************************
+					Device Announce
+**********************************************************/
+
+/// cluster ID for ZDO Device_annce, broadcast by a node after (re)joining
+#define ZDO_DEVICE_ANNCE			0x0013
+
+/// frame format for a ZDO Device_annce
+typedef PACKED_STRUCT zdo_device_annce_t {
+	uint8_t		transaction;
+	uint16_t		network_addr_le;
+	uint64_t		ieee_address_le;
+	uint8_t		capability;
+} zdo_device_annce_t;
+
 
 #endif		// __XBEE_ZIGBEE_H